@@ -0,0 +1,62 @@
+#include <cgi/cgi.hpp>
+#include <vector>
+#include <climits>
+#include <fcgi_stdio.h>
+
+/*! \file body.cpp
+  \brief Implementation of CGI::BodyStream
+*/
+
+namespace CGI {
+
+  /*
+   * Buffers are recycled between requests (and instances) instead of being allocated for each of them.
+   * The pool is per thread so that no locking is required.
+   */
+
+  static thread_local std::vector<std::unique_ptr<char[]>> pool;
+
+  BodyStream::~BodyStream() {
+    if(buffer)
+      pool.push_back(std::move(buffer));
+  }
+
+  size_t BodyStream::read(char* dest, size_t n) {
+    size_t total = 0;
+    if(n > remaining)
+      n = remaining;
+    while(total < n) {
+      size_t chunk = n - total;
+      if(in and chunk > INT_MAX)
+	chunk = INT_MAX; // FCGX_GetStr takes an int
+      size_t got = in ? FCGX_GetStr(dest + total, chunk, in) : fread(dest + total, 1, chunk, stdin);
+      if(not got) {
+	remaining = 0;
+	throw Common::Exception("Request body ended before CONTENT_LENGTH bytes", E_BODY_INCOMPLETE, __LINE__, __FILE__);
+      }
+      total += got;
+      remaining -= got;
+    }
+    return total;
+  }
+
+  size_t BodyStream::next(const char*& data) {
+    if(not remaining)
+      return 0;
+    if(not buffer) {
+      if(pool.empty())
+	buffer.reset(new char[CHUNK_SIZE]);
+      else {
+	buffer = std::move(pool.back());
+	pool.pop_back();
+      }
+    }
+    data = buffer.get();
+    return read(buffer.get(), CHUNK_SIZE);
+  }
+
+  void BodyStream::skip() {
+    const char *data;
+    while(next(data));
+  }
+}
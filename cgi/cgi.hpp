@@ -3,8 +3,19 @@
 #include <global.hpp>
 #include <common/common.hpp>
 #include <ctime>
+#include <array>
 #include <string>
 #include <memory>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <sys/uio.h>
+#include <dirent.h>
+#include <list>
+#include <unordered_map>
+#include <optional>
 
 /*! \file cgi.hpp
   \brief %CGI namespace definition
@@ -12,6 +23,10 @@
   File contains definition of various classes and functions for the %CGI module
 */
 
+struct FCGX_Stream; // fcgiapp.h, only pointers are used in this header
+struct z_stream_s; // zlib.h, z_stream
+struct evp_md_ctx_st; // openssl/evp.h, EVP_MD_CTX
+
 /*! \namespace CGI
   \brief The %CGI - %Common Gateway Interface module.
 
@@ -35,6 +50,15 @@ namespace CGI {
     E_POST_NOT_BINARY, //!< POST data is not binary. \sa Request::getBinPost
     E_RESPONSE_BINARY, //!< Response is binary. \sa Response::getCompleteBody Response::getContentBody
     E_RESPONSE_NOT_BINARY, //!< Response is not binary. \sa Response::getBinaryData
+    E_BODY_INCOMPLETE, //!< Request body ended before CONTENT_LENGTH bytes were read. \sa BodyStream
+    E_BODY_CONSUMED, //!< Request body was already (partially) read through BodyStream. \sa Request::getBinPost
+    E_MULTIPART_INVALID, //!< Malformed or truncated multipart/form-data body, or text fields too large. \sa Multipart
+    E_UPLOAD_FAILED, //!< Uploaded file could not be written to a temporary file. \sa Request::getFiles
+    E_OUTPUT_FAILED, //!< Response could not be written to its destination. \sa Sink
+    E_HEADERS_SENT, //!< Headers were already sent, they cannot be changed. \sa Response::flush
+    E_COMPRESSION_FAILED, //!< zlib failed to compress the response. \sa Deflater
+    E_SESSION_STORE, //!< %Session could not be read from or written to storage. \sa SessionStore
+    E_BODY_TOO_LARGE, //!< CONTENT_LENGTH exceeds the request_max_body configuration parameter. \sa Request::checkLength
   };
 
   /*! \brief Hex decoder
@@ -61,10 +85,88 @@ namespace CGI {
 
   std::string& encodeHex(std::string& source);
 
+  /*! \brief Lookup table for hexadecimal digits
+
+    Indexed by the (unsigned) byte, holds the value of the digit (0-15) or 0xFF if the byte is not a hexadecimal digit.
+  */
+
+  extern const std::array<unsigned char, 256> hexValues;
+
+  /*! \brief Bulk percent decoder
+
+    Decodes \%XX escapes and '+' (space) in place. Runs of bytes which need no decoding are skipped using SSE2/AVX2
+    when available. Malformed escapes are kept as they are.
+
+    \param[in,out] data Buffer to be decoded
+    \param[in] length Length of data in bytes
+    \return Length of the decoded data, which is never larger than length
+  */
+
+  size_t urldecode(char* data, size_t length);
+
+  /*! \brief Bulk percent encoder
+
+    Appends the percent encoded form of data to out. Only alphanumerics and !'()*-._ are emitted as they are,
+    runs of those are copied using SSE2/AVX2 when available.
+
+    \param[in] data Data to be encoded
+    \param[in,out] out String to which the encoded data is appended
+    \return std::string& out
+  */
+
+  std::string& urlencode(std::string_view data, std::string& out);
+
+  const size_t HTTP_DATE_LENGTH = 29; //!< Length of the date written by #httpDate
+
+  /*! \brief Formats a time as an HTTP date (RFC 7231 IMF-fixdate), for instance Sun, 06 Nov 1994 08:49:37 GMT
+
+    Does not depend on the locale and is safe to call from several threads. The last formatted time is cached per thread,
+    hence formatting the same second again (cookies expiring together) is a copy.
+
+    \param[in] t Time since UNIX Epoch
+    \param[out] out Buffer of at least #HTTP_DATE_LENGTH bytes, no NUL is written
+    \return #HTTP_DATE_LENGTH
+  */
+
+  size_t httpDate(time_t t, char* out);
+
+  /*! \brief Single pass query string tokenizer
+
+    Walks a mutable buffer containing a query string (or an urlencoded POST body) exactly once, splitting it into key/value pairs
+    at '&' and ';'. Escapes (\%XX and '+') are decoded in place while walking, hence the views returned by #next point into the buffer
+    itself and nothing is allocated. Empty pairs and pairs with an empty key are skipped.
+
+    \remark The buffer is modified and must outlive the views returned by #next.
+  */
+
+  class Tokenizer {
+  private:
+    char* cursor; //!< Position of the next unread byte
+    char* end; //!< One past the last byte of the buffer
+
+  public:
+
+    /*! \brief Constructor
+      \param[in,out] buffer Query string to be tokenized (need not be NUL terminated)
+      \param[in] length Length of buffer in bytes
+    */
+
+    Tokenizer(char* buffer, size_t length) : cursor(buffer), end(buffer + length) {}
+
+    /*! \brief Extracts the next pair
+      \param[out] key Decoded key
+      \param[out] value Decoded value, empty if the pair has no '='
+      \return false if the buffer is exhausted, true otherwise
+    */
+
+    bool next(std::string_view& key, std::string_view& value);
+  };
+
   /*! \brief Query string parser
 
     Query string is the main source of data for HTTP applications, because most of the requests are HTTP GET.
     The data is available in enviornment variable QUERY_STRING as per the %CGI/1.1 protocol.
+    \sa Tokenizer
    */
 
   class Parser {
@@ -73,17 +175,6 @@ namespace CGI {
     //! The raw query string supplied to CGI::Parser::Parser or CGI::Parser::setQstr
     
     std::string source;
-
-    /*! \brief Query string sanitizer
-
-      Removes certain string combinations in the query string that can cause hindrance while parsing it.
-
-      \param[in,out] s The query string
-      \param[in] n Offset to start checking from
-      \coder{Ershad K,ershus}
-    */
-
-    void _sanitize(std::string& s, size_t n = 1) const;
     
   public:
 
@@ -127,25 +218,331 @@ namespace CGI {
     
   };
 
+  /*! \brief Storage backend of sessions
+
+    Sessions are stored by id as their data dictionary and expiry time. The store in use is registered as "sessionstore"
+    in Common::Registry (Server sets it up, see session_store in its configuration), without one sessions last for a
+    single request. Implementations must be safe to call from several threads.
+  */
+
+  class SessionStore {
+  public:
+
+    /*! \brief Reads a session
+      \param[in] id %Session id
+      \param[out] data Data of the session, filled only if it is found
+      \param[out] expire Expiry time of the session, set only if it is found
+      \return false if the session does not exist or has expired
+      \throw Common::Exception with #E_SESSION_STORE if the storage cannot be read
+    */
+
+    virtual bool load(const std::string& id, Common::PersistentDict& data, time_t& expire) = 0;
+
+    /*! \brief Writes a session, replacing what was stored under the id
+      \param[in] id %Session id
+      \param[in] data Data of the session
+      \param[in] expire Expiry time of the session
+      \throw Common::Exception with #E_SESSION_STORE if the storage cannot be written
+    */
+
+    virtual void save(const std::string& id, const Common::PersistentDict& data, time_t expire) = 0;
+
+    /*! \brief Removes a session, nothing happens if it does not exist
+      \param[in] id %Session id
+    */
+
+    virtual void remove(const std::string& id) = 0;
+
+    virtual ~SessionStore() {}
+  };
+
+  /*! \brief In-process session store
+
+    A hash map split into shards, each with its own lock, so that workers handling different sessions rarely wait for each
+    other. Expired sessions are dropped when they are looked up, and each shard is swept for them every #SWEEP_INTERVAL
+    writes. Sessions live as long as the process.
+  */
+
+  class MemorySessionStore : public SessionStore {
+  private:
+
+    //! Stored session
+    struct record_t {
+      Common::PersistentDict data; //!< %Session data, shared with the requests which loaded it
+      time_t expire; //!< Expiry time
+    };
+
+    //! One stripe of the map
+    struct shard_t {
+      std::mutex lock; //!< Guards #sessions and #writes
+      std::unordered_map<std::string, record_t> sessions; //!< Sessions by id
+      unsigned int writes; //!< Writes since the last sweep
+
+      shard_t() : writes(0) {}
+    };
+
+    std::unique_ptr<shard_t[]> shards; //!< Shards
+    size_t mask; //!< Number of shards - 1, the number of shards being a power of two
+
+    //! \return Shard holding the session id
+    shard_t& shardOf(const std::string& id) const {
+      return shards[Common::hash(id) & mask];
+    }
+
+  public:
+
+    static const unsigned int SWEEP_INTERVAL = 1024; //!< Writes to a shard between two sweeps
+
+    //! \param[in] count Number of shards, rounded up to a power of two
+    MemorySessionStore(size_t count = 64);
+
+    bool load(const std::string& id, Common::PersistentDict& data, time_t& expire);
+    void save(const std::string& id, const Common::PersistentDict& data, time_t expire);
+    void remove(const std::string& id);
+
+    //! \return Number of sessions held, including expired ones which have not been swept yet
+    size_t size() const;
+  };
+
+  /*! \brief File backed session store
+
+    One file per session in a directory, holding the expiry time on the first line and the data urlencoded as a query
+    string on the second (read back using Tokenizer). Files are written to a temporary name and renamed into place, hence
+    a reader never sees a partial session. Sessions survive restarts and are visible to every process using the directory.
+    Expired files are removed when they are looked up, and every write checks the next #SWEEP_STEP files of the directory,
+    hence the files of sessions never looked up again are removed a few at a time, never by a scan of the whole directory.
+  */
+
+  class FileSessionStore : public SessionStore {
+  private:
+    std::string directory; //!< Directory holding the session files
+    DIR* cursor; //!< Where the sweep stopped in #directory, NULL till the first write
+    std::mutex sweepLock; //!< Guards #cursor
+
+    //! Removes the expired files among the next #SWEEP_STEP sessions, and temporary files left by writers which died
+    void sweep();
+
+    /*! \brief Path of the file of a session
+      \throw Common::Exception with #E_SESSION_STORE if the id contains characters other than alphanumerics and -
+    */
+
+    std::string pathOf(const std::string& id) const;
+
+  public:
+
+    static const unsigned int SWEEP_STEP = 4; //!< Session files checked for expiry per write
+    static const time_t STALE_TEMPORARY = 3600; //!< Age in seconds after which a temporary file is taken as abandoned
+
+    //! \param[in] _directory Existing directory, writable by the process
+    FileSessionStore(std::string _directory) : directory(_directory), cursor(NULL) {}
+
+    ~FileSessionStore();
+
+    bool load(const std::string& id, Common::PersistentDict& data, time_t& expire);
+    void save(const std::string& id, const Common::PersistentDict& data, time_t expire);
+    void remove(const std::string& id);
+  };
+
+  /*! \brief Session store shared by processes through a memory mapped file
+
+    For deployments running several FastCGI processes per host. The sessions live in a file (normally under /dev/shm)
+    mapped by every process, hence a session written by one process is seen by the others, and the sessions survive the
+    restart of any of them.
+
+    The file holds a fixed number of fixed size slots, addressed by open addressing (linear probing over at most
+    #MAX_PROBE slots from the home slot of the id). Each slot is guarded by a sequence lock: lookups take no lock, they
+    copy the slot and retry if a writer was active meanwhile. Writers serialize on a spinlock per stripe of home slots,
+    which records the pid of the holder so that the lock of a process which died holding it can be taken over.
+    Every write also checks the next #SWEEP_STEP slots for expired sessions, hence expired sessions are cleared a few
+    slots at a time, never by a sweep of the whole table.
+
+    A session must fit into a slot: its encoded data may take the slotSize constructor parameter less about 128 bytes.
+    #save drops a larger session (and reports it on stderr), the client then starts over with an empty one. When all
+    #MAX_PROBE slots in reach of an id are taken by live sessions, the one expiring first is evicted.
+  */
+
+  class ShmSessionStore : public SessionStore {
+  private:
+    int fd; //!< Descriptor of the mapped file
+    char* base; //!< Start of the mapping
+    size_t length; //!< Length of the mapping
+    uint32_t slots; //!< Number of slots, a power of two
+    uint32_t slotSize; //!< Size of a slot in bytes
+
+    //! \return Address of slot i
+    char* slotAt(uint32_t i) const {
+      return base + 4096 + (size_t) i * slotSize; // The first page holds the header
+    }
+
+  public:
+
+    static const unsigned int MAX_PROBE = 32; //!< Slots searched from the home slot of an id
+    static const unsigned int SWEEP_STEP = 4; //!< Slots checked for expired sessions per write
+    static const unsigned int STRIPES = 256; //!< Number of writer locks
+
+    /*! \brief Maps the file, creating and initializing it if it does not exist or is empty
+      \param[in] path Path of the file, for instance /dev/shm/cxxcms-sessions
+      \param[in] _slots Number of slots, rounded up to a power of two
+      \param[in] _slotSize Size of a slot in bytes, including about 128 bytes of bookkeeping and the id
+      \throw Common::Exception with #E_SESSION_STORE if the file cannot be created or mapped, or if it is in use with
+      another layout (remove it to start over with other sizes)
+    */
+
+    ShmSessionStore(std::string path, uint32_t _slots = 16384, uint32_t _slotSize = 2048);
+
+    ~ShmSessionStore();
+
+    bool load(const std::string& id, Common::PersistentDict& data, time_t& expire);
+    void save(const std::string& id, const Common::PersistentDict& data, time_t expire);
+    void remove(const std::string& id);
+  };
+
+  /*! \brief Signs sessions so that they can be kept by the client, in the session cookie
+
+    A session which fits is serialized together with its expiry time and carried in the cookie as a token, authenticated
+    with HMAC-SHA256 under a server side key (session_signing_key in the configuration). Reading such a session costs no
+    storage access at all. Sessions too large for the cookie (see #limit) are kept in the SessionStore as usual.
+
+    A token looks like s.PAYLOAD.MAC, both parts in base64url. It is never a valid store id, hence the two kinds of
+    session ids cannot be mistaken for each other.
+
+    \remark The data is authenticated, not encrypted: the client can read it but not change it
+  */
+
+  class SessionSigner {
+  private:
+    evp_md_ctx_st* innerPad; //!< SHA-256 state after absorbing the key XOR ipad, copied for every MAC
+    evp_md_ctx_st* outerPad; //!< SHA-256 state after absorbing the key XOR opad
+    size_t limit; //!< Maximum length of a token
+
+    //! Computes HMAC-SHA256 of data into out (32 bytes)
+    void mac(const char* data, size_t length, unsigned char* out) const;
+
+  public:
+
+    /*! \brief Constructor
+      \param[in] _key HMAC key, at least 32 bytes
+      \param[in] _limit Maximum length of a token, larger sessions are not signed. Browsers keep cookies of up to 4096 bytes
+      including the name and attributes.
+      \throw Common::Exception with #E_SESSION_STORE if the key is too short
+    */
+
+    SessionSigner(std::string _key, size_t _limit = 3072);
+
+    ~SessionSigner();
+
+    SessionSigner(const SessionSigner&) = delete;
+    SessionSigner& operator=(const SessionSigner&) = delete;
+
+    //! \return true if id is a token made by #sign, as opposed to an id of a stored session
+    static bool isToken(const std::string& id) {
+      return id.size() > 2 and id[0] == 's' and id[1] == '.';
+    }
+
+    /*! \brief Makes a token carrying a session
+      \param[in] data Data of the session
+      \param[in] expire Expiry time of the session
+      \param[out] token The token, set only if the session fits
+      \return false if the token would be longer than #limit
+    */
+
+    bool sign(const Common::PersistentDict& data, time_t expire, std::string& token) const;
+
+    /*! \brief Reads a session back from a token
+      \param[in] token Token sent by the client
+      \param[out] data Data of the session, filled only if the token is valid
+      \param[out] expire Expiry time of the session, set only if the token is valid
+      \return false if the token is malformed, longer than #limit, not signed with the key or expired
+    */
+
+    bool verify(const std::string& token, Common::PersistentDict& data, time_t& expire) const;
+  };
+
   /*! \brief Class to manage sessions
 
     HTTP is a stateless protocol, hence we have to handle sessions on the server side.
     We track users by using a cookie for session id and storing relevant data on server side.
 
-    \remark The session id, data, expire and response is common to all instances (static) and hence, over multiple instances, the methods
-    will work on the same piece of %data instead of having their own copy.
-    \note Module is not complete
-    \todo Complete the module using database as storage.\n
-    %Session destruction should be written to storage.
+    \remark The session id, data and expire are kept in a state_t which is shared by the instances serving the same request
+    (Request and Response, see #share), hence the methods of those work on the same piece of %data instead of having their own copy.
+    The mode (#response) belongs to each instance. Instances serving different requests, possibly in different threads, share nothing.
+
+    A session resumed from the cookie of a request is read from the SessionStore only when its data is first accessed,
+    requests which do not use the session cost no storage access. Changes are written back by #commit at the end of the
+    request, and only if there were any. An id which is not found in the store is replaced by a new one.
+    If a SessionSigner is provided, sessions small enough are carried in the cookie instead of the store.
     \coder{Nilesh G,nileshgr}
   */
 
   class Session {
   private:
-    static std::string id; //!< %Session identifier (id)
-    static Dict_t data; //!< %Session data dictionary
-    static time_t expire; //!< %Session expiry time
-    static bool response; //!< Variable to track if it is in response mode or request mode
+
+    //! %Session state, shared by the instances serving the same request
+    struct state_t {
+      std::string id; //!< %Session identifier (id)
+      Common::PersistentDict data; //!< %Session data dictionary, each change makes a new version
+      time_t expire; //!< %Session expiry time
+      SessionStore* store; //!< Storage of the session, NULL if sessions are not stored
+      const SessionSigner* signer; //!< Signer of sessions kept in the cookie, NULL if they are all stored
+      bool pending; //!< #id came from the client, #data and #expire are yet to be loaded from #store or the token
+      bool dirty; //!< #data or #expire was changed during this request
+      bool stored; //!< A copy of the session is in #store under #id
+      bool committed; //!< #commit has run, #id is final
+      bool sent; //!< #id went out in a cookie, it is kept from then on \sa settleId
+
+      state_t() : expire(0), store(NULL), signer(NULL), pending(false), dirty(false), stored(false), committed(false), sent(false) {}
+    };
+
+    std::shared_ptr<state_t> state; //!< %Session state
+    bool response; //!< Variable to track if it is in response mode or request mode
+
+    //! \return A new, random session id
+    static std::string newId();
+
+    /*! \brief Loads #state from storage if it is pending
+      \throw Common::Exception with #E_SESSION_STORE if the storage cannot be read
+    */
+
+    void load() const {
+      if(state->pending)
+	fetch();
+    }
+
+    //! Does the work of #load, out of line
+    void fetch() const;
+
+  protected:
+
+    /*! \brief Starts a new session
+
+      Replaces #state by a new one with a new id, expire set from the session_expire configuration parameter and no data.
+      Called by the constructor and by Request::reset and Response::reset when an instance is reused for another request.
+    */
+
+    void renew();
+
+    /*! \brief Continues the session with the given id, which is loaded from storage on first access
+      \param[in] id %Session id sent by the client
+    */
+
+    void resume(const std::string& id);
+
+    /*! \brief Makes this instance work on the session of another one
+      \param[in] other Instance whose state is to be shared
+    */
+
+    void share(const Session& other) {
+      state = other.state;
+    }
+
+    /*! \brief Fixes the session id before it is sent in a cookie
+
+      Called by Response when the headers are built. Headers sent before #commit (streaming, an early flush) cannot be
+      followed by another cookie, while the data may still change: such a session is stored under an id instead of
+      being carried in a token, so that the id sent stays valid.
+    */
+
+    void settleId();
     
   public:
 
@@ -159,24 +556,41 @@ namespace CGI {
     Session();
 
     /*! \brief Constructor for loading existing session present in storage (request mode)
-      \param[in] _id Session ID to be loaded
-      \todo Throw Common::Exception if session is not found
+      \param[in] _id Session ID to be loaded, on first access. If empty, the instance has no session till #renew or #resume.
     */
     
     Session(std::string _id);
 
-    //! \return %Session ID
+    //! \return %Session ID, which is the signed token after #commit for a session carried in the cookie \sa SessionSigner
     const std::string getSessionId() const {
-      return Session::id;
+      return state->id;
+    }
+
+    //! \return true if the session was changed during this request and is to be written back \sa commit
+    bool isDirty() const {
+      return state->dirty;
     }
 
+    /*! \brief Writes the session back to storage if it was changed during this request
+
+      Called by Server once the handler has finished. The expiry time is moved session_expire seconds ahead.
+      With a SessionSigner, a session which fits in the cookie becomes a token (the new session id) instead, a stored copy
+      is removed. One which has outgrown the cookie is stored under a new id. Once the id has been sent (see #settleId)
+      the session is stored under it.
+
+      \throw Common::Exception with #E_SESSION_STORE if the storage cannot be written
+    */
+
+    void commit();
+
     /*! \brief Method to retrive everything present in #data
-      \remark Returns a new dictionary, modifications won't reflect.
+      \remark Returns a snapshot which shares its entries with #data, hence it costs the same however large the session is.
+      Later modifications to the session won't reflect in it.
       \sa getParam(const std::string)
-      \return Dict_ptr_t of a newly allocated #Dict_t containing everything from #data
+      \return Version of #data at the time of the call
     */
 
-    virtual Dict_ptr_t getData() const;
+    virtual Common::PersistentDict getData() const;
 
     /*! \brief Method to set parameter
 
@@ -191,7 +605,9 @@ namespace CGI {
     virtual const Session& setParam(std::string name, std::string value) {
       if(not response)
 	throw Common::Exception("You are not allowed to set a session parameter in a request", E_SESSION_REQUEST, __LINE__, __FILE__);
-      Session::data[name] = value;
+      load();
+      state->data = state->data.set(name, value);
+      state->dirty = true;
       return *this;
     }
 
@@ -204,11 +620,23 @@ namespace CGI {
       \throw Common::Exception with #E_PARAM_NOT_FOUND if key is not found in #data
     */
           
-    virtual const std::string getParam(std::string name) const {
-      Dict_t::iterator i;
-      if((i = Session::data.find(name)) == Session::data.end())
-	throw Common::Exception("Session parameter `" + name + "` was not found", E_PARAM_NOT_FOUND, __LINE__, __FILE__);
-      return i->second;
+    virtual const std::string getParam(Common::Key name) const {
+      const std::string* value = tryGetParam(name);
+      if(not value)
+	throw Common::Exception("Session parameter `" + std::string(name.getName()) + "` was not found", E_PARAM_NOT_FOUND, __LINE__, __FILE__);
+      return *value;
+    }
+
+    /*! \brief Retrieves a parameter without throwing when it is absent
+      \param[in] name Name of the session parameter
+      \return Pointer to the value, valid till the session is next changed, or NULL if name is not found in #data
+      \throw Common::Exception with #E_SESSION_STORE if the session had to be loaded and the storage cannot be read
+    */
+
+    const std::string* tryGetParam(Common::Key name) const {
+      load();
+      const Common::PersistentDict::value_type* i = state->data.find(name.getName(), name.getHash());
+      return i ? &i->second : NULL;
     }
 
     /*! \brief Load session #data from an existing dictionary
@@ -218,7 +646,9 @@ namespace CGI {
     */
     
     const Session& loadData(const Dict_t& _data) {
-      Session::data = _data;
+      load();
+      state->data = Common::PersistentDict(_data);
+      state->dirty = true;
       return *this;
     }
 
@@ -229,14 +659,16 @@ namespace CGI {
      */
     
     Session& setExpireTime(time_t _expire) {
-      Session::expire = _expire;
+      load();
+      state->expire = _expire;
       return *this;
     }
 
     //! Retrieve expire time (since UNIX Epoch)
 
     time_t getExpireTime() const {
-      return Session::expire;
+      load();
+      return state->expire;
     }
   };
 
@@ -263,6 +695,9 @@ namespace CGI {
     Cookies can be used for storage of data on the client side.\n
     This is basically a cookie-jar.
 
+    In request mode the Cookie header is split in a single pass into views of names and values (#received), nothing is
+    copied. A cookie_t is only built for a cookie which is asked for by name, or for all of them by #getCookies.
+
     \coder{Nilesh G,nileshgr}
   */
 
@@ -271,12 +706,34 @@ namespace CGI {
     typedef std::map<std::string, cookie_t> cookie_dict_t; //!< Type definition for cookie dictionary
     typedef std::pair<std::string, cookie_t> cookie_tuple_t; //!< Type definition for cookie pair
   private:
-    cookie_dict_t cookies; //!< Dictionary to store cookies, consisting of name & cookie_t
+    /*! \brief Dictionary to store cookies, consisting of name & cookie_t
+
+      In response mode these are the cookies to be set. In request mode it caches the cookie_t built from #received.
+    */
+    mutable cookie_dict_t cookies;
+    /*! \brief Cookies sent by the client (request mode), views into #source, in the order sent
+
+      Not indexed: a request carries a few dozen cookies at most and looks few of them up, comparing lengths first is
+      cheaper than hashing every name.
+    */
+    std::vector<std::pair<std::string_view, std::string_view>> received;
+    const char* source; //!< Cookie header parsed into #received, NULL if none
+    std::string owned; //!< Copy of the header when it was passed as a string \sa Cookie(std::string)
     /*! \brief Type of jar - will be true if jar is for response
 
       If jar is in request mode, then only value will be used in cookie_t.
     */
     bool response; 
+
+    /*! \brief Splits a Cookie header into #received
+
+      Pairs are separated by ';', whitespace around names and values is ignored, as are double quotes around a value and
+      pairs without a name. All pairs are kept, lookups find the first of several cookies with the same name.
+
+      \param[in] header NUL terminated value of the header, it must outlive #received
+    */
+
+    void parse(const char* header);
     
   public:
     
@@ -285,7 +742,7 @@ namespace CGI {
       By default we assume response mode. If Cookie::Cookie(std::string) is called, we switch to request mode.
     */
 
-    Cookie() : response (true) {}
+    Cookie() : source(NULL), response (true) {}
 
     /*! \brief Constructor- cookie parser
 
@@ -298,17 +755,56 @@ namespace CGI {
     
     Cookie(std::string _cookies);
 
+    //! Copy constructor, the copy refers to its own copy of the header if it was passed as a string
+    Cookie(const Cookie& other) : cookies(other.cookies), source(NULL), owned(other.owned), response(other.response) {
+      if(other.source)
+	parse(other.source == other.owned.c_str() ? owned.c_str() : other.source);
+    }
+
+    //! Assignment, see the copy constructor
+    Cookie& operator=(const Cookie& other) {
+      if(this != &other) {
+	cookies = other.cookies;
+	owned = other.owned;
+	response = other.response;
+	received.clear();
+	source = NULL;
+	if(other.source)
+	  parse(other.source == other.owned.c_str() ? owned.c_str() : other.source);
+      }
+      return *this;
+    }
+
     /*! \brief Returns a copy of cookie_t
       \param[in] name Name of the cookie
       \throw Common::Exception with #E_PARAM_NOT_FOUND if name is not found in #cookies
       \return cookie_t copy present in #cookies
     */
 
-    cookie_t getCookie(std::string name) {
-      cookie_dict_t::iterator i;
-      if((i = cookies.find(name)) == cookies.end())
-	throw Common::Exception("Cookie named `" + name + "` was not found", E_PARAM_NOT_FOUND, __LINE__, __FILE__);
-      return i->second;
+    cookie_t getCookie(Common::Key name) const {
+      const cookie_t* cookie = tryGetCookie(name);
+      if(not cookie)
+	throw Common::Exception("Cookie named `" + std::string(name.getName()) + "` was not found", E_PARAM_NOT_FOUND, __LINE__, __FILE__);
+      return *cookie;
+    }
+
+    /*! \brief Looks a cookie up without throwing when it is absent
+      \param[in] name Name of the cookie
+      \return Pointer to the cookie_t in #cookies, valid till the jar is changed, or NULL if name is not found
+    */
+
+    const cookie_t* tryGetCookie(Common::Key name) const;
+
+    /*! \brief Value of a cookie sent by the client, without building a cookie_t
+      \param[in] name Name of the cookie
+      \return View of the value, valid as long as the Cookie header, or std::nullopt if name was not sent
+    */
+
+    std::optional<std::string_view> tryGetCookieValue(Common::Key name) const {
+      for(const std::pair<std::string_view, std::string_view>& sent : received)
+	if(sent.first == name.getName())
+	  return sent.second;
+      return std::nullopt;
     }
 
     /*! \brief Sets a cookie
@@ -323,100 +819,721 @@ namespace CGI {
       if(not response)
 	throw Common::Exception("You are not allowed to set a cookie in request mode", E_COOKIE_REQUEST, __LINE__, __FILE__);
       cookies[name] = data;
+      return *this;
     }
 
     /*! \brief Returns all cookies
-      \return Copy of #cookies
+      \remark In request mode this builds a cookie_t for every cookie sent, #tryGetCookieValue is cheaper for a few of them
+      \return Read only reference to #cookies
     */
 
-    cookie_dict_t getCookies() {
-      return cookies;
-    }
+    const cookie_dict_t& getCookies() const;
+
+  protected:
+
+    /*! \brief Empties the jar, so that an instance can be reused for another request
+      \param[in] _response Mode of the jar, true for response mode
+      \param[in] _cookies If not NULL, the jar is refilled by parsing this string \sa Cookie(std::string)
+    */
+
+    void resetCookies(bool _response, const char* _cookies = NULL);
   };
 
-  /*! \brief Class to manage HTTP %Request data
+  /*! \brief Lazy view of the environment block
 
-    When a client requests a resource, the webserver feeds the parameters via HTTP headers which are translated to environment variables
-    (and stdin if POST) to the application. The methods in this class can be used to read data present in those.
+    Keeps the raw envp pointer instead of copying it. The variables used on every request (#hot_t) are indexed by a single
+    scan in the constructor, the rest are resolved on demand by scanning envp. Nothing is allocated.
 
-    \coder{Nilesh G,nileshgr}
+    \remark envp must outlive the instance
   */
 
-  class Request : public Cookie, public Session {
-  private:    
-    Dict_t env; //!< Dictionary to hold environment variables
-    Dict_t get; //!< Dictionary to hold HTTP GET data
-    Dict_t post; //!< Dictionary to hold HTTP POST data
-    bool rawpostdata; //!< Variable to check if the POST data received was ASCII or binary (file upload)
-    char *postBuffer; //!< If rawpostdata is true, then we cannot use post to store data, we need to use buffer
-    char *postBuffer_fncall; //!< Pointer to the memory created and returned by #getBinPost, so that it can be deleted[]d on class destruction
-    
+  class Environment {
   public:
 
-    /*! \brief Options for which dictionary should be used
+    //! Variables indexed by the constructor
+    enum hot_t {
+      QUERY_STRING,
+      REQUEST_METHOD,
+      CONTENT_LENGTH,
+      CONTENT_TYPE,
+      HTTP_COOKIE,
+      HTTP_HOST,
+      SERVER_NAME,
+      HTTPS,
+      HTTP_HTTPS,
+      HTTP_ACCEPT_ENCODING,
+      REQUEST_URI,
+      HOT_COUNT, //!< Number of indexed variables, not a variable
+    };
 
-      #getData and #getParam use this to decide which dictionary to use.
-      #getParam uses bitwise operators to search for the request key, hence multiple dictionaries to search for can be specifed
-    */
+  private:
+    char** envp; //!< Raw environment block
+    const char* hot[HOT_COUNT]; //!< Values of the indexed variables, NULL if not present
 
-    enum option_t {
-      GET, //!< Use only HTTP GET data present in #get
-      POST, //!< Use only HTTP POST data present in #post
-      SESSION, //!< Use only CGI::Session
-      ENV, //!< Use only environment variables data present in #env
-    };
+    //! Looks up a variable which is not indexed in envp
+    const char* scan(std::string_view name) const;
 
-    /*! \brief Constructor
-      \param[in] env Array of C-style strings for environment variables
-      \throw Common::Exception with #E_INVALID_CONTENT_LENGTH if request mode is #POST and CONTENT_LENGTH = 0
-     */
+  public:
 
-    Request(char** env);
+    /*! \brief Constructor, indexes #hot_t variables
+      \param[in] _envp NULL terminated array of NAME=VALUE strings
+    */
 
-    /*! \brief Returns all data or combination of requested data
+    Environment(char** _envp = NULL) {
+      reset(_envp);
+    }
 
-      All the requested data is contained in the class variables, #get, #post, #env and data available from CGI::Session \n
-      This function will return the requested one (#Dict_ptr_t) or if multiple ones are specified (bitwise operators)
-      then the returned #Dict_t will contain combination of those.
+    /*! \brief Points the view to another environment block and indexes it again
+      \param[in] _envp NULL terminated array of NAME=VALUE strings
+    */
 
-      \sa Cookie::getCookies
-      \param[in] option The dictionary which should be returned. Defaults to all values bitwise-or'd \sa #option_t
-      \throw Common::Exception with #E_POST_BINARY if option has POST and #rawpostdata is true.
-      \return #Dict_ptr_t for a #Dict_t containing the requested data      
-     */
+    void reset(char** _envp);
 
-    Dict_ptr_t getData(unsigned option = GET | POST | SESSION | ENV);
+    /*! \brief Value of an indexed variable
+      \param[in] key Variable
+      \return Value of the variable or NULL if it is not present
+    */
 
-    /*! \brief Returns value of single request parameter
+    const char* get(hot_t key) const {
+      return hot[key];
+    }
 
-       The default order for searching is GPSE - Get, Post, %Session and Environment variables
+    /*! \brief Value of any variable
+      \param[in] name Name of the variable, an indexed one is read from its slot
+      \return Value of the variable or NULL if it is not present
+    */
 
-       \sa Cookie::getCookie
-       \param[in] name Name of the request parameter
-       \param[in] option Dictionaries to search for. Defaults to all five of them (GPSE). \sa #option_t
-       \return Value of the request parameter
-       \throw Common::Exception with #E_PARAM_NOT_FOUND if requested parameter is not found in the specified dictionaries.
-       \throw Common::Exception with #E_POST_BINARY if option has #POST and #rawpostdata is true
-     */
+    const char* find(Common::Key name) const {
+      return name.getSlot() >= 0 and name.getSlot() < HOT_COUNT ? hot[name.getSlot()] : scan(name.getName());
+    }
 
-    std::string getParam(std::string name, unsigned option = GET | POST | SESSION | ENV);
 
-    /*! \brief Returns post data if it is binary (file upload)
+    //! \return The raw environment block, for iterating over all variables
+    char** getEnvp() const {
+      return envp;
+    }
+  };
 
-      We cannot use getParam or getData if HTTP POST data is binary
+  /*! \brief Incremental reader for the request body
 
-      \remark Do not delete[] the pointer returned. It is take care of by ~Request
-      \throw Common::Exception with #E_POST_NOT_BINARY if #rawpostdata = false
-      \return char* #postBuffer_fncall
+    As per %CGI specifications, the request body is available in stdin. BodyStream reads it in large chunks
+    (FCGX_GetStr from the request's input stream, or bulk fread through the FastCGI stdio layer if there is none)
+    instead of byte by byte, and never past CONTENT_LENGTH.
+    #next hands out the body chunk by chunk in a buffer taken from a per-thread pool, so that large uploads can be
+    consumed without holding the whole body in memory. #read copies straight into memory provided by the caller.
+  */
+
+  class BodyStream {
+  public:
+    static const size_t CHUNK_SIZE = 65536; //!< Size of the pooled buffer, hence the largest chunk returned by #next
+
+  private:
+    size_t length; //!< Total length of the body (CONTENT_LENGTH)
+    size_t remaining; //!< Bytes not yet read
+    std::unique_ptr<char[]> buffer; //!< Pooled buffer used by #next, acquired on first use
+    FCGX_Stream* in; //!< Input stream of the request, stdin is used if NULL
+
+  public:
+
+    /*! \brief Constructor
+      \param[in] _length Length of the body, CONTENT_LENGTH
+      \param[in] _in Input stream of the request, stdin is used if NULL
+    */
+
+    BodyStream(size_t _length = 0, FCGX_Stream* _in = NULL) : length(_length), remaining(_length), in(_in) {}
+
+    //! Destructor, returns #buffer to the pool
+    ~BodyStream();
+
+    /*! \brief Starts reading another body, #buffer is kept
+      \param[in] _length Length of the body, CONTENT_LENGTH
+      \param[in] _in Input stream of the request, stdin is used if NULL
+    */
+
+    void reset(size_t _length, FCGX_Stream* _in = NULL) {
+      length = remaining = _length;
+      in = _in;
+    }
+
+    /*! \brief Reads the next chunk
+      \param[out] data Set to the chunk, valid till the next call
+      \return Size of the chunk, at most #CHUNK_SIZE. 0 if the body has been read completely.
+      \throw Common::Exception with #E_BODY_INCOMPLETE if stdin ends prematurely
+    */
+
+    size_t next(const char*& data);
+
+    /*! \brief Reads into memory provided by the caller
+      \param[out] dest Destination
+      \param[in] n Maximum number of bytes to be read
+      \return Number of bytes read, which is less than n only if the body has been read completely
+      \throw Common::Exception with #E_BODY_INCOMPLETE if stdin ends prematurely
+    */
+
+    size_t read(char* dest, size_t n);
+
+    //! Reads and discards the rest of the body
+    void skip();
+
+    //! \return Total length of the body
+    size_t getLength() const {
+      return length;
+    }
+
+    //! \return Number of bytes not yet read
+    size_t getRemaining() const {
+      return remaining;
+    }
+
+    //! \return true if the body has been read completely
+    bool eof() const {
+      return not remaining;
+    }
+  };
+
+  //! Headers of a single part of a multipart/form-data body
+
+  struct part_t {
+    std::string name; //!< Name of the form field
+    std::string filename; //!< Name of the uploaded file, empty if the part is a text field
+    std::string contentType; //!< Content-Type of the part, empty if not specified
+  };
+
+  //! File uploaded using multipart/form-data, spilled to a temporary file
+
+  struct file_t {
+    std::string name; //!< Name of the form field
+    std::string filename; //!< Name of the file as sent by the client
+    std::string contentType; //!< Content-Type as sent by the client
+    std::string path; //!< Path of the temporary file, which is removed by ~Request
+    size_t size; //!< Size of the file in bytes
+
+    file_t() : size(0) {}
+  };
+
+  /*! \brief Streaming multipart/form-data parser
+
+    The body is fed chunk by chunk using #feed, the data of each part is handed to a Handler as soon as it is known
+    not to be a part of the boundary. Boundaries are searched using Boyer-Moore-Horspool. At most one chunk plus the
+    length of the boundary is buffered, hence memory use does not depend on the size of the body.
+
+    \sa RFC 7578
+  */
+
+  class Multipart {
+  public:
+
+    //! Receiver of the parsed parts
+    class Handler {
+    public:
+      virtual ~Handler() {}
+
+      /*! \brief Called when headers of a part have been parsed
+	\param[in] part Headers of the part
+      */
+
+      virtual void begin(const part_t& part) = 0;
+
+      /*! \brief Called with the data of the current part, possibly several times
+	\param[in] data Data, valid only during the call
+	\param[in] length Length of data
+      */
+
+      virtual void data(const char* data, size_t length) = 0;
+
+      //! Called when the current part is complete
+      virtual void end() = 0;
+    };
+
+  private:
+    enum state_t { PREAMBLE, DELIMITER, HEADERS, BODY, DONE };
+
+    Handler& handler; //!< Receiver of the parts
+    std::string delimiter; //!< CRLF + "--" + boundary
+    size_t skip[256]; //!< Boyer-Moore-Horspool bad character table for #delimiter
+    std::string window; //!< Bytes fed but not yet processed
+    state_t state; //!< Parser state
+    part_t part; //!< Headers of the current part
+
+    //! \return Position of #delimiter in #window, starting at from, or std::string::npos
+    size_t search(size_t from) const;
+
+    //! Parses the headers of a part, present in window[from, to), into #part
+    void parseHeaders(size_t from, size_t to);
+
+  public:
+
+    /*! \brief Constructor
+      \param[in] boundary Boundary, as present in CONTENT_TYPE
+      \param[in] _handler Receiver of the parts
+    */
+
+    Multipart(std::string_view boundary, Handler& _handler);
+
+    /*! \brief Feeds the next chunk of the body
+      \param[in] data Chunk
+      \param[in] length Length of the chunk
+      \throw Common::Exception with #E_MULTIPART_INVALID if the body is malformed
+    */
+
+    void feed(const char* data, size_t length);
+
+    /*! \brief Signals the end of the body
+      \throw Common::Exception with #E_MULTIPART_INVALID if the closing boundary was not seen
+    */
+
+    void finish();
+
+    /*! \brief Extracts the boundary parameter from a Content-Type value
+      \param[in] contentType Value of CONTENT_TYPE
+      \return The boundary, empty if contentType is not multipart/form-data or has no boundary
+    */
+
+    static std::string_view getBoundary(std::string_view contentType);
+  };
+
+  /*! \brief Class to manage HTTP %Request data
+
+    When a client requests a resource, the webserver feeds the parameters via HTTP headers which are translated to environment variables
+    (and stdin if POST) to the application. The methods in this class can be used to read data present in those.
+
+    \coder{Nilesh G,nileshgr}
+  */
+
+  class Request : public Cookie, public Session {
+  private:    
+    Environment env; //!< Environment variables, a view of the environment block passed to the constructor
+    Common::FlatDict get; //!< Dictionary to hold HTTP GET data, views into #queryBuffer
+    Common::FlatDict post; //!< Dictionary to hold HTTP POST data, views into #postBuffer
+    std::string queryBuffer; //!< Copy of QUERY_STRING, decoded in place by CGI::Tokenizer
+    bool rawpostdata; //!< Variable to check if the POST data received was ASCII or binary (file upload)
+    char *postBuffer; //!< POST data. If rawpostdata is false, it is decoded in place by CGI::Tokenizer and #post holds views into it
+    bool postMapped; //!< true if #postBuffer was allocated using mmap, see #allocatePost
+    size_t contentLength; //!< CONTENT_LENGTH, parsed once by the constructor. 0 if the request has no body.
+    BodyStream body; //!< Request body. Read completely by the constructor if it is urlencoded, left to the user otherwise.
+    std::string_view boundary; //!< Boundary if the body is multipart/form-data and is not parsed yet, empty otherwise
+    std::deque<std::string> postStrings; //!< Names and values of multipart/form-data text fields, #post holds views into them
+    std::vector<file_t> files; //!< Files uploaded using multipart/form-data
+
+    /*! \brief Checks the length of a body against the request_max_body configuration parameter
+      \param[in] length Length of the body, as announced by the client
+      \throw Common::Exception with #E_BODY_TOO_LARGE if length exceeds request_max_body (#MAX_BODY if not configured)
+    */
+
+    void checkLength(size_t length) const;
+
+    /*! \brief Parses the body if it is multipart/form-data and was not parsed yet
+      \param[in] handler Receiver of the file parts, if NULL they are spilled to temporary files
+      \throw Common::Exception with #E_BODY_TOO_LARGE if #contentLength exceeds request_max_body, see #checkLength
+    */
+
+    void parsePending(Multipart::Handler* handler = NULL);
+
+    /*! \brief Allocates #postBuffer
+
+      Bodies of #MAP_THRESHOLD bytes or more are placed in anonymous memory mappings, so that they are returned to the
+      system as soon as the request is done instead of fragmenting the heap.
+
+      \param[in] length Size of the buffer
+      \throw Common::Exception with #E_BODY_TOO_LARGE as #checkLength, before anything is allocated for a length the
+      client is free to choose
+    */
+
+    void allocatePost(size_t length);
+
+    /*! \brief Allocates #postBuffer and reads the body into it
+      \throw Common::Exception as #allocatePost and BodyStream::read do, #postBuffer is released then
+    */
+
+    void readPost();
+
+    //! Releases #postBuffer
+    void releasePost();
+    
+  public:
+
+    static const size_t MAP_THRESHOLD = 1048576; //!< Smallest POST body stored in an anonymous memory mapping
+    static const size_t MAX_BODY = 16777216; //!< Largest POST body buffered or parsed as multipart unless request_max_body says otherwise
+
+    /*! \brief Options for which dictionary should be used
+
+      #getData and #getParam use this to decide which dictionary to use.
+      #getParam uses bitwise operators to search for the request key, hence multiple dictionaries to search for can be specifed
+    */
+
+    enum option_t {
+      GET = 1, //!< Use only HTTP GET data present in #get
+      POST = 2, //!< Use only HTTP POST data present in #post
+      SESSION = 4, //!< Use only CGI::Session
+      ENV = 8, //!< Use only environment variables data present in #env
+    };
+
+    /*! \brief Constructor
+      \param[in] env Array of C-style strings for environment variables. It must outlive the instance, #env refers to it.
+      \param[in] in FastCGI input stream of the request (FCGX_Request::in), stdin is used if NULL
+      \throw Common::Exception with #E_INVALID_CONTENT_LENGTH if request mode is #POST and CONTENT_LENGTH = 0
+     */
+
+    Request(char** env, FCGX_Stream* in = NULL);
+
+    /*! \brief Reuses the instance for another request
+
+      Equivalent to destroying the instance and constructing it again with env, but the memory held by the
+      dictionaries and buffers is retained and reused.
+
+      \param[in] env Array of C-style strings for environment variables
+      \param[in] in FastCGI input stream of the request (FCGX_Request::in), stdin is used if NULL
+      \throw Common::Exception with #E_INVALID_CONTENT_LENGTH if request mode is #POST and CONTENT_LENGTH = 0
+    */
+
+    void reset(char** env, FCGX_Stream* in = NULL);
+
+    /*! \brief Returns the request body stream
+
+      If the POST data is binary (file upload), the constructor does not read it. It can then be consumed incrementally
+      using the stream, or read completely by #getBinPost, but not both.
+
+      \return BodyStream& #body
+    */
+
+    BodyStream& getBodyStream() {
+      return body;
+    }
+
+    /*! \brief Returns all data or combination of requested data
+
+      All the requested data is contained in the class variables, #get, #post, #env and data available from CGI::Session \n
+      This function will return the requested one (#Dict_ptr_t) or if multiple ones are specified (bitwise operators)
+      then the returned #Dict_t will contain combination of those.
+
+      \sa Cookie::getCookies
+      \param[in] option The dictionary which should be returned. Defaults to all values bitwise-or'd \sa #option_t
+      \throw Common::Exception with #E_POST_BINARY if option has POST and #rawpostdata is true.
+      \return #Dict_ptr_t for a #Dict_t containing the requested data      
+     */
+
+    Dict_ptr_t getData(unsigned option = GET | POST | SESSION | ENV);
+
+    /*! \brief Returns value of single request parameter
+
+       The default order for searching is GPSE - Get, Post, %Session and Environment variables
+
+       \sa Cookie::getCookie
+       \param[in] name Name of the request parameter
+       \param[in] option Dictionaries to search for. Defaults to all five of them (GPSE). \sa #option_t
+       \return Value of the request parameter
+       \throw Common::Exception with #E_PARAM_NOT_FOUND if requested parameter is not found in the specified dictionaries.
+       \throw Common::Exception with #E_POST_BINARY if option has #POST and #rawpostdata is true
+     */
+
+    std::string getParam(Common::Key name, unsigned option = GET | POST | SESSION | ENV);
+
+    /*! \brief Retrieves a request parameter without throwing when it is absent
+
+      Searches like #getParam. The view refers to the request (or, for a session parameter, to the session data) and is
+      valid till the instance is reset or the session is changed.
+
+      \param[in] name Name of the request parameter
+      \param[in] option Dictionaries to search for \sa #option_t
+      \return Value of the request parameter, std::nullopt if it is not found in the specified dictionaries
+      \throw Common::Exception with #E_POST_BINARY if option has #POST and #rawpostdata is true
+    */
+
+    std::optional<std::string_view> tryGetParam(Common::Key name, unsigned option = GET | POST | SESSION | ENV);
+
+    /*! \brief Parses a multipart/form-data body, handing the file parts to handler
+
+      Text fields (parts without a filename) are added to the POST data, they are held in memory and may take 1 MiB in
+      all. The data of the file parts is handed to handler as it is read,
+      instead of being spilled to temporary files. Otherwise the body is parsed as soon as POST data or #getFiles
+      is requested, and files are spilled to temporary files.
+
+      \param[in] handler Receiver of the file parts
+      \throw Common::Exception with #E_POST_NOT_BINARY if the body is not multipart/form-data or was already parsed
+      \throw Common::Exception with #E_MULTIPART_INVALID if the body is malformed or its text fields take more than 1 MiB
+      \throw Common::Exception with #E_BODY_TOO_LARGE if the body exceeds the request_max_body configuration parameter
+      \return Request& for cascading operations
+    */
+
+    Request& parseMultipart(Multipart::Handler& handler);
+
+    /*! \brief Returns files uploaded using multipart/form-data
+
+      The files are spilled to temporary files, which are removed when the instance is destroyed.
+
+      \throw Common::Exception with #E_UPLOAD_FAILED if a temporary file cannot be written
+      \return const reference to #files
+    */
+
+    const std::vector<file_t>& getFiles() {
+      parsePending();
+      return files;
+    }
+
+    /*! \brief Returns post data if it is binary (file upload)
+
+      We cannot use getParam or getData if HTTP POST data is binary.
+      The body is read on the first call, the view refers to #postBuffer and no copy is made.
+
+      \remark The view is valid till the instance is destroyed
+      \throw Common::Exception with #E_POST_NOT_BINARY if #rawpostdata = false
+      \throw Common::Exception with #E_BODY_CONSUMED if the body was already read using #getBodyStream, or by a call which
+      failed with #E_BODY_INCOMPLETE because the body ended early
+      \return Read only view of #postBuffer, #contentLength bytes long
     */
     
-    char* getBinPost();
+    std::string_view getBinPost();
+
+    //! \return #contentLength
+    size_t getContentLength() const {
+      return contentLength;
+    }
+
+    /*! \brief Value of a frequently used environment variable, without a lookup or a copy
+      \param[in] key Variable \sa Environment::hot_t
+      \return Value of the variable or NULL if it is not present
+    */
+
+    const char* getEnv(Environment::hot_t key) const {
+      return env.get(key);
+    }
 
-    //! Destructor, to deallocate memory in #postBuffer and #postBuffer_fncall (if present)
+    //! Destructor, to deallocate memory in #postBuffer and remove temporary files
 
     ~Request();
   };
 
+  /*! \brief Destination of a response
+
+    Takes the response as a list of buffers (iovec) and writes them one after the other, so that the headers and the body
+    need not be concatenated into one buffer. \sa Response::flush
+  */
+
+  class Sink {
+  public:
+
+    /*! \brief Writes the buffers in order
+      \param[in] iov Buffers
+      \param[in] count Number of buffers
+      \throw Common::Exception with #E_OUTPUT_FAILED if the data could not be written
+    */
+
+    virtual void write(const struct iovec* iov, int count) = 0;
+
+    virtual ~Sink() {}
+  };
+
+  //! Sink writing to a file descriptor using writev, for instance STDOUT_FILENO when running as plain %CGI
+
+  class FdSink : public Sink {
+  private:
+    int fd; //!< Destination file descriptor
+
+  public:
+
+    //! \param[in] _fd Destination file descriptor
+    FdSink(int _fd) : fd(_fd) {}
+
+    void write(const struct iovec* iov, int count);
+  };
+
+  //! Sink writing to the output stream of a FastCGI request using FCGX_PutStr
+
+  class FCGXSink : public Sink {
+  private:
+    FCGX_Stream* out; //!< Destination stream (FCGX_Request::out)
+
+  public:
+
+    //! \param[in] _out Destination stream (FCGX_Request::out)
+    FCGXSink(FCGX_Stream* _out) : out(_out) {}
+
+    void write(const struct iovec* iov, int count);
+  };
+
+  //! Sink appending to a string, for keeping a response (or a compressed body) in memory
+
+  class StringSink : public Sink {
+  private:
+    std::string& out; //!< Destination string
+
+  public:
+
+    //! \param[in] _out Destination string, data is appended to it
+    StringSink(std::string& _out) : out(_out) {}
+
+    void write(const struct iovec* iov, int count);
+  };
+
+  /*! \brief Streaming zlib compressor for response bodies
+
+    Compresses data written in parts into the gzip or the zlib (HTTP "deflate") format and passes the output on to a Sink
+    through a fixed size buffer. An instance is reused across responses, #begin resets the zlib state without
+    reallocating it unless the format or the level changes.
+  */
+
+  class Deflater {
+  public:
+
+    //! Content codings which can be produced
+    enum format_t {
+      IDENTITY, //!< No compression
+      GZIP, //!< gzip
+      DEFLATE, //!< zlib format, which is what HTTP calls deflate
+    };
+
+    //! How much of the compressed data #write pushes out to the sink
+    enum mode_t {
+      CONTINUE, //!< As much as zlib decides, more data follows
+      SYNC, //!< Everything written so far, so that the client can decode it, more data follows
+      FINISH, //!< Everything, and ends the stream
+    };
+
+    static const size_t BUFFER_SIZE = 16384; //!< Size of the output buffer
+
+  private:
+    std::unique_ptr<z_stream_s> stream; //!< zlib state, allocated by the first #begin
+    std::unique_ptr<char[]> buffer; //!< Output buffer
+    format_t format; //!< Format of #stream
+    int level; //!< Compression level of #stream
+    bool finished; //!< The stream was ended by #FINISH
+
+  public:
+
+    Deflater();
+
+    ~Deflater();
+
+    /*! \brief Starts a new stream
+      \param[in] _format #GZIP or #DEFLATE
+      \param[in] _level zlib compression level, 1 (fastest) to 9 (smallest)
+      \throw Common::Exception with #E_COMPRESSION_FAILED if zlib cannot be initialized
+    */
+
+    void begin(format_t _format, int _level);
+
+    /*! \brief Compresses data and writes the output to a sink
+      \param[in] data Data to be compressed, may be empty
+      \param[in] mode See #mode_t
+      \param[in] sink Destination of the compressed data
+      \throw Common::Exception with #E_COMPRESSION_FAILED if zlib fails or #E_OUTPUT_FAILED if the sink fails
+    */
+
+    void write(std::string_view data, mode_t mode, Sink& sink);
+
+    /*! \brief Picks the content coding to be used for a request
+      \param[in] acceptEncoding Value of the Accept-Encoding request header, may be NULL
+      \return The acceptable format with the highest q value (gzip on a tie), #IDENTITY if neither is acceptable
+    */
+
+    static format_t negotiate(const char* acceptEncoding);
+
+    /*! \brief Tells if a media type is worth compressing
+      \param[in] contentType Value of the Content-Type header
+      \return false for types which are compressed already (images other than SVG, audio, video, archives, fonts, PDF)
+    */
+
+    static bool compressible(std::string_view contentType);
+  };
+
+  /*! \brief Cache of rendered response bodies along with their gzip-compressed form
+
+    Pages which come out byte-identical on every hit (CSS, JS, static pages) are rendered and compressed once. A body is
+    stored under a key chosen by the caller (usually the REQUEST_URI) and found by a hash of its content, so that keys
+    yielding the same content share one entry and one compression. Content is compared on a hash match, bodies whose
+    hashes collide are kept apart. A hit hands the entry to Response::setCached,
+    which sends the precompressed form to clients accepting gzip without rendering or compressing anything.
+
+    Memory is bounded by a byte budget (bodies, compressed bodies and keys), least recently used entries are evicted
+    to stay within it. One instance is shared by all the worker threads of Server, it is registered as "responsecache".
+  */
+
+  class ResponseCache {
+  public:
+
+    //! Cached body, immutable once stored
+    struct entry_t {
+      uint64_t hash; //!< Hash of #contentType and #body
+      std::string contentType; //!< Content-Type of the body
+      std::string body; //!< Body as rendered
+      std::string gzip; //!< gzip-compressed #body, empty if compression does not pay off
+    };
+
+    typedef std::shared_ptr<const entry_t> entry_ptr_t; //!< Entries are handed out by shared pointer, eviction does not invalidate them
+
+  private:
+
+    //! Entry together with its bookkeeping
+    struct slot_t {
+      entry_ptr_t entry; //!< Cached entry
+      std::vector<std::string> keys; //!< Keys in #byKey which refer to the entry
+      size_t bytes; //!< Memory accounted for the entry and its keys
+    };
+
+    typedef std::list<slot_t> lru_t; //!< Slots, most recently used first
+
+    size_t budget; //!< Maximum of #used, 0 disables caching
+    size_t used; //!< Bytes accounted for all slots
+    int level; //!< zlib level used for the compressed forms
+    lru_t lru; //!< Slots in order of use
+    std::unordered_map<uint64_t, lru_t::iterator> byHash; //!< Slots by content hash, a body colliding with another one is not listed
+    std::unordered_map<std::string, lru_t::iterator> byKey; //!< Slots by key
+    std::mutex lock; //!< Guards all of the above
+
+    //! Removes key from #byKey and from the slot it refers to
+    void unbind(const std::string& key);
+
+    //! Binds key to slot, replacing a previous binding
+    void bind(const std::string& key, lru_t::iterator slot);
+
+    //! Evicts least recently used slots till #used is within #budget
+    void evict();
+
+  public:
+
+    /*! \brief Constructor
+      \param[in] _budget Maximum number of bytes held, 0 disables caching (#store still compresses and returns the entry)
+      \param[in] _level zlib level used to compress bodies, the cost is paid once per body hence it defaults to the best
+    */
+
+    ResponseCache(size_t _budget, int _level = 9) : budget(_budget), used(0), level(_level) {}
+
+    /*! \brief Looks up the body stored under a key, making it the most recently used
+      \param[in] key Key passed to #store
+      \return The entry, or an empty pointer if it is not cached
+    */
+
+    entry_ptr_t find(const std::string& key);
+
+    /*! \brief Stores a body under a key
+
+      If a body with the same content is already cached, its entry (and its compressed form) is reused and the key is
+      bound to it. Otherwise the body is compressed, outside of the lock, and a new entry is added.
+
+      \param[in] key Key under which the body is found by #find, a previous binding of the key is replaced
+      \param[in] contentType Content-Type of the body
+      \param[in] body Body as rendered
+      \return The entry, to be passed to Response::setCached
+      \throw Common::Exception with #E_COMPRESSION_FAILED if compression fails
+    */
+
+    entry_ptr_t store(const std::string& key, std::string_view contentType, std::string_view body);
+
+    //! \return Number of bytes held
+    size_t size() {
+      std::lock_guard<std::mutex> guard (lock);
+      return used;
+    }
+
+    /*! \brief Hash used to identify content
+      \param[in] data Data to be hashed
+      \param[in] seed Seed, allows chaining hashes of several pieces
+      \return 64-bit hash (wyhash style, 8 bytes per multiplication)
+    */
+
+    static uint64_t contentHash(std::string_view data, uint64_t seed = 0);
+  };
+
   /*! \brief Class to manage response data
 
     Response body will be generated by this class depending on the parameters fed via methods.
@@ -427,7 +1544,12 @@ namespace CGI {
 
   class Response : public Cookie, public Session {
   private:
-    Dict_t headers; //!< Headers are sent before body and even Cookie is present in HTTP header.
+    static const int HEADER_SLOTS = Common::KNOWN_KEYS - Common::KNOWN_HEADERS; //!< Number of headers in Common::knownKeys
+    static_assert(HEADER_SLOTS <= 32, "Known headers must fit in knownHeaderMask");
+
+    Dict_t headers; //!< Headers are sent before body and even Cookie is present in HTTP header. Holds those not in #knownHeaders.
+    std::string knownHeaders[HEADER_SLOTS]; //!< Values of the headers in Common::knownKeys, in the same order
+    uint32_t knownHeaderMask; //!< Bit n is set if knownHeaders[n] is set
     std::string completeBody; //!< The complete response body (includes headers)
     std::string contentBody; //!< Content body (response body excluding headers)
     /*! \brief Binary mode
@@ -440,12 +1562,68 @@ namespace CGI {
     std::unique_ptr<char[]> binaryData; //!< Holds pointer to binary data
     size_t binaryLength; //!< Holds length of binary data
     std::string headerString; //!< String to store headers (parsed)
+    Request* request; //!< Request being answered, "request" from Common::Registry is used if NULL \sa setRequest
+    Sink* sink; //!< Destination bound by #setSink, used by #flush() and in streaming mode
+    bool headersSent; //!< Headers were committed to the sink, only body follows
+    size_t highWatermark; //!< Streaming mode: #contentBody is sent once it holds this many bytes, 0 disables streaming
+    size_t lowWatermark; //!< Streaming mode: bytes kept back in #contentBody when it is sent
+    int compressionLevel; //!< zlib level used for compression, 0 disables compression \sa setCompression
+    size_t compressionMin; //!< Bodies smaller than this are not compressed
+    Deflater::format_t encoding; //!< Content coding chosen for this response, decided when the headers are sent
+    std::unique_ptr<Deflater> deflater; //!< Compressor, created on first use and reused
+    ResponseCache::entry_ptr_t cached; //!< Cached body to be sent instead of #contentBody \sa setCached
+
+    //! \return Request being answered \sa #request
+    const Request& getRequest() const;
+
+    /*! \brief Finds a header
+      \param[in] name Name of the header, a known one is read from #knownHeaders
+      \return Value of the header, NULL if it is not set
+    */
+
+    std::string* findHeader(Common::Key name);
+
+    /*! \brief Gives access to a header, setting it to an empty value if it is not set
+      \param[in] name Name of the header
+      \return Reference to the value of the header
+    */
+
+    std::string& header(Common::Key name);
+
+    //! \param[in] name Name of the header to unset, nothing happens if it is not set
+    void dropHeader(Common::Key name);
+
+    /*! \brief Decides on compression for this response, sets #encoding and the Content-Encoding and Vary headers
+
+      Content-Length is unset when the body is compressed, as the compressed length is not known before it is sent.
+
+      \param[in] size Size of the complete body, SIZE_MAX if it is not yet known
+    */
+
+    void chooseEncoding(size_t size);
+
+    /*! \brief Sends first and second to the sink, preceded by the headers if they were not sent yet
+      \param[in] sink Destination
+      \param[in] first Data to be sent
+      \param[in] second Data to be sent after first
+      \param[in] mode If the body is compressed, how much of it is to be pushed out \sa Deflater::mode_t
+    */
+
+    void send(Sink& sink, std::string_view first, std::string_view second, Deflater::mode_t mode);
+
+    /*! \brief Sends #contentBody followed by more to #sink, headers first if not yet sent
+      \param[in] more Data which would have been appended to #contentBody
+      \param[in] keep Number of trailing bytes which are kept back in #contentBody instead of being sent
+    */
+
+    void drain(std::string_view more, size_t keep);
 
     /*! \brief Parses #headers into #headerString
 
       Headers are sent as Name-value pairs separated by colon and CRLF.
-      We translate #headers into this format and store it in #headerString, so that
-      it can be directly prepended to the output
+      We translate #headers, the session cookie and the cookies of the jar into this format and store it in #headerString,
+      so that it can be directly prepended to the output. Everything is appended to #headerString, which is sized once
+      and rebuilt from scratch on every call, hence calling it again does not repeat headers.
     */
     void setupHeaders();
 
@@ -461,12 +1639,47 @@ namespace CGI {
     /*! \brief Constructor, sets up intial values for various parameters
 
       The constructor sets the session cookie, and sets the default headers to the following values:\n
-      Content-Encoding: utf-8
-      Content-Type: text/html
+      Content-Type: text/html; charset=utf-8
     */
 
     Response();
 
+    /*! \brief Reuses the instance for another request
+
+      Restores the state set up by the constructor and starts a new session, or takes over the session of the bound
+      request (see #setRequest) which must have been reset before. The memory held by the body and header
+      buffers is retained and reused.
+
+      \return Response& for cascading operations
+    */
+
+    Response& reset();
+
+    /*! \brief Binds the response to the request it answers
+
+      The response takes over the session of the request and reads HTTPS from its environment while setting up
+      the session cookie. Needed when several requests are served at the same time, see Server.
+
+      \param[in] _request Request being answered, it must outlive the binding
+      \return Response& for cascading operations
+    */
+
+    Response& setRequest(Request& _request) {
+      request = &_request;
+      share(_request);
+      return *this;
+    }
+
+    //! \return true if the response is binary \sa #setBinaryBody
+    bool isBinary() const {
+      return binary;
+    }
+
+    //! \return Length of the data returned by #getBinaryBody (headers and binary data)
+    size_t getBinaryBodyLength() const {
+      return headerString.size() + binaryLength;
+    }
+
     /*! \brief Sets parameters in the specified context
 
       If #HEADER is used as option then the parameter will be added to #headers
@@ -477,11 +1690,15 @@ namespace CGI {
       \return Response& for cascading operation
     */
     
-    Response& setParam(std::string name, std::string value, option_t option) {
-      if(option == HEADER)
-	headers[name] = value;
+    Response& setParam(Common::Key name, std::string value, option_t option) {
+      if(option == HEADER) {
+	if(headersSent)
+	  throw Common::Exception("Header " + std::string(name.getName()) + " cannot be set, headers were already sent", E_HEADERS_SENT, __LINE__, __FILE__);
+	header(name) = value;
+      }
       if(option == SESSION)
-	Session::setParam(name, value);
+	Session::setParam(std::string(name.getName()), value);
+      return *this;
     }
 
     /*! \brief Returns the specified parameter from the context
@@ -494,17 +1711,118 @@ namespace CGI {
       \return std::string Value of parameter
     */
 
-    std::string getParam(std::string name, option_t option);
+    std::string getParam(Common::Key name, option_t option);
+
+    /*! \brief Returns the specified parameter from the context without throwing when it is absent
+      \param name Name of parameter
+      \param option Context of parameter (#option_t)
+      \return Pointer to the value, valid till the parameter is changed, or NULL if it is not found in the context
+    */
+
+    const std::string* tryGetParam(Common::Key name, option_t option);
 
     /*! \brief Appends data to #contentBody
+
+      In streaming mode (see #setStreaming) the body is sent to the bound sink as soon as #contentBody would reach
+      the high watermark, the data is then handed to the sink directly instead of being copied.
+
       \param data Data to be appended      
       \return Response& for cascading operations
     */
 
-    Response& appendBody(std::string data) {
+    Response& appendBody(std::string_view data) {
       if(binary)
 	throw Common::Exception("Response is binary", E_RESPONSE_BINARY, __LINE__, __FILE__);
-      contentBody += data;
+      if(highWatermark and sink and contentBody.size() + data.size() >= highWatermark)
+	drain(data, lowWatermark);
+      else
+	contentBody.append(data);
+      return *this;
+    }
+
+    /*! \brief Binds the destination of the response
+
+      Needed by #flush() and by streaming mode. The binding is dropped by #reset.
+
+      \param[in] _sink Destination, it must outlive the binding, NULL unbinds
+      \return Response& for cascading operations
+    */
+
+    Response& setSink(Sink* _sink) {
+      sink = _sink;
+      return *this;
+    }
+
+    /*! \brief Turns on streaming mode
+
+      Instead of holding the complete page, #contentBody becomes a bounded output buffer: once it would reach high bytes,
+      the headers (on the first time) and the buffered body are sent to the bound sink, keeping the last low bytes back.
+      Keeping bytes back makes the sink receive fragments of at least high - low bytes, even if the page is produced
+      in small pieces. Time to first byte and memory no longer grow with the size of the page. The setting outlives #reset.
+
+      \remark Headers and cookies cannot be changed once they have been sent.
+      \param[in] high High watermark in bytes, 0 turns streaming off
+      \param[in] low Low watermark in bytes, must be less than high
+      \return Response& for cascading operations
+    */
+
+    Response& setStreaming(size_t high, size_t low = 0) {
+      highWatermark = high;
+      lowWatermark = low < high ? low : 0;
+      return *this;
+    }
+
+    //! \return true if the headers were sent \sa flush
+    bool isCommitted() const {
+      return headersSent;
+    }
+
+    /*! \brief Sends the headers (if not yet sent) and the buffered body to the bound sink now
+
+      Can be called early, for instance after the head of a page has been generated, so that the client receives it
+      while the rest is being generated. A compressed body is flushed such that the client can decode what it has got.
+      Does nothing if no sink is bound.
+
+      \throw Common::Exception with #E_OUTPUT_FAILED if the sink fails
+      \return Response& for cascading operations
+    */
+
+    Response& flush() {
+      if(sink)
+	flush(*sink, false);
+      return *this;
+    }
+
+    /*! \brief Sends a cached body instead of #contentBody
+
+      Sets Content-Type from the entry and discards the body appended so far. The precompressed form is sent as it is
+      to clients accepting gzip (Vary and Content-Encoding are set), the others get the body as rendered. Nothing is
+      compressed on the fly and nothing is copied.
+
+      \param[in] entry Entry from ResponseCache::find or ResponseCache::store
+      \throw Common::Exception with #E_HEADERS_SENT if headers were already sent
+      \return Response& for cascading operations
+    */
+
+    Response& setCached(ResponseCache::entry_ptr_t entry);
+
+    /*! \brief Turns on compression of the body
+
+      When the headers are sent, the body is compressed with gzip or deflate if the client accepts one of them
+      (Accept-Encoding), Content-Encoding has not been set by the caller, the Content-Type is not compressed already
+      (see Deflater::compressible) and the body is not smaller than min bytes. Content-Encoding and Vary are set
+      accordingly. Applies to #flush, not to #getCompleteBody and #getBinaryBody. The setting outlives #reset.
+
+      \param[in] level zlib compression level, 1 (fastest) to 9 (smallest), 0 turns compression off
+      \param[in] min Bodies smaller than this many bytes are sent as they are. In streaming mode the size is not
+      known before the headers are sent, then the body is compressed if it fills the high watermark.
+      \return Response& for cascading operations
+    */
+
+    Response& setCompression(int level, size_t min = 1024) {
+      compressionLevel = level < 0 ? 0 : level > 9 ? 9 : level;
+      compressionMin = min;
+      return *this;
     }
 
     /*! \brief Clears #contentBody, #completeBody and if #binary is true, #binaryData (deallocates memory)
@@ -550,14 +1868,94 @@ namespace CGI {
       binary = true;
       binaryData = std::move(_binaryData);
       binaryLength = _binaryLength;
+      return *this;
     }
 
     /*! \brief Returns binary body
       \throw Common::Exception with #E_RESPONSE_NOT_BINARY if #binary is false
       \return std::unique_ptr<char[]> of memory location containing the parsed header string and binary data.
+      \sa flush, which emits the response without this copy
     */
 
     std::unique_ptr<char[]> getBinaryBody();
+
+    /*! \brief Emits the response (headers and body) to a sink
+
+      The headers and the body (#contentBody, or exactly #binaryLength bytes of #binaryData in binary mode) are handed
+      to the sink as two buffers, nothing is concatenated or copied. Headers which were already sent are skipped and
+      #contentBody is emptied, hence the method can be called several times to send a body in parts.
+      If the body is compressed (see #setCompression), the last call must have last set to true.
+
+      \param[in] sink Destination
+      \param[in] last true if nothing follows, ends the compressed stream
+      \throw Common::Exception with #E_OUTPUT_FAILED if the sink fails or #E_COMPRESSION_FAILED if compression fails
+      \return Response& for cascading operations
+    */
+
+    Response& flush(Sink& sink, bool last = true);
+  };
+
+  /*! \brief FastCGI application server
+
+    Runs a pool of worker threads, each with its own FCGX_Request, which take turns in accepting connections on the
+    listening socket (FCGX_Accept_r under #acceptLock) and then serve them concurrently.
+    The configuration is loaded once at startup and registered as "config" in Common::Registry of every worker, the
+    registry being per thread. Each worker creates a single Request and Response for its first request and then resets
+    and reuses them for every following one, so that their dictionaries and buffers are recycled instead of being
+    allocated per hit. The current request of a worker is registered as "request" in its registry.
+    Responses are buffered unless the response_stream_high configuration parameter is set, see Response::setStreaming
+    (response_stream_low sets the low watermark). Bodies are compressed as per Response::setCompression, at the level
+    given by response_compression_level (default 1, 0 disables) for bodies of response_compression_min bytes or more
+    (default 1024).
+    A ResponseCache holding at most response_cache_size bytes (default 16 MiB, 0 disables it) is shared by the workers
+    and registered as "responsecache" in the registry of each.
+    Sessions are kept in a MemorySessionStore, or in a FileSessionStore in the directory session_path if session_store is
+    "file", or in a ShmSessionStore (for several processes) if it is "shm", mapping session_path (default
+    /dev/shm/cxxcms-sessions) with session_slots slots of session_slot_size bytes. The store is registered as "sessionstore" and the session of each request is committed after the handler returns.
+  */
+
+  class Server {
+  public:
+    typedef std::function<void(Request&, Response&)> handler_t; //!< Function which generates the response for a request
+
+  private:
+    std::unique_ptr<Common::ConfigWatcher> config; //!< Configuration, loaded by the constructor and reloaded when the file changes
+    handler_t handler; //!< Request handler
+    std::unique_ptr<ResponseCache> cache; //!< Cache shared by the workers
+    std::unique_ptr<SessionStore> sessions; //!< %Session storage shared by the workers
+    std::unique_ptr<SessionSigner> signer; //!< Signer of sessions kept in cookies, NULL unless session_signing_key is set
+    std::mutex acceptLock; //!< Serializes FCGX_Accept_r of the workers
+
+    //! Body of a worker thread, accepts and serves requests till the FastCGI library stops accepting
+    void work();
+
+  public:
+
+    /*! \brief Constructor, loads the configuration and provides it, the response cache and the session store as Common::Registry services
+
+      Changes to the configuration file are picked up by the workers from their next request on. Parameters used to set
+      up the server itself, such as the session store or the number of threads, take a restart.
+
+      \param[in] configFile Path to the XML configuration file \sa Common::Config
+      \param[in] _handler Request handler
+      \throw Common::Exception with Common::E_CONFIG_LOAD if the configuration cannot be loaded
+    */
+
+    Server(std::string configFile, handler_t _handler);
+
+    //! Destructor, withdraws the services provided by the constructor \sa Common::Registry::provide
+    ~Server();
+
+    /*! \brief Runs the worker pool
+
+      Returns when the FastCGI library signals that no more requests are to be accepted and all workers have finished.
+      A Common::Exception thrown while handling a request results in a 500 response, the worker continues.
+
+      \param[in] threads Number of worker threads, 0 means the server_threads configuration parameter (default 1)
+      \return Exit status for main()
+    */
+
+    int run(unsigned int threads = 0);
   };
 }
 #endif
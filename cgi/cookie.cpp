@@ -1,4 +1,5 @@
 #include <cgi/cgi.hpp>
+#include <cstring>
 
 /*! \file cookie.cpp
   \brief Implementation of CGI::Cookie
@@ -6,29 +7,81 @@
 
 namespace CGI {
 
-  Cookie::Cookie(std::string _cookies) : response (false) {
-    while(_cookies.size()) {
-      size_t delimiter = std::string::npos;
-      std::string key = "", value = "", extract = "";
-      if((delimiter = _cookies.find(';')) != std::string::npos) {
-	extract = _cookies.substr(0, delimiter);
-	_cookies.erase(0, delimiter + 2); // +2 because we have a space between multiple cookies. NAME1=VALUE1; NAME2=VALUE2; NAME3=VALUE3
-      }
-      else {
-	extract = _cookies;
-	cookies.clear();
-      }
-      if((delimiter = extract.find('=')) != std::string::npos) {
-	key = extract.substr(0, delimiter);
-	value = extract.substr(delimiter + 1);
-      }
-      else {
-	key = extract;
-	value = "";
+  static inline bool isBlank(char c) {
+    return c == ' ' or c == '\t';
+  }
+
+  void Cookie::parse(const char* header) {
+    source = header;
+    received.clear();
+    const char *p = header, *end = header + std::strlen(header);
+
+    while(p != end) {
+      const char* next = static_cast<const char*>(std::memchr(p, ';', end - p));
+      if(not next)
+	next = end;
+
+      // One pair in [p, next), trimmed on both sides and split at the first '='
+
+      const char *first = p, *last = next;
+      p = next == end ? end : next + 1;
+      while(first != last and isBlank(*first))
+	first++;
+      while(last != first and isBlank(last[-1]))
+	last--;
+      const char* equals = static_cast<const char*>(std::memchr(first, '=', last - first));
+      const char *nameEnd = equals ? equals : last, *value = equals ? equals + 1 : last;
+      while(nameEnd != first and isBlank(nameEnd[-1]))
+	nameEnd--;
+      while(value != last and isBlank(*value))
+	value++;
+      if(last - value >= 2 and *value == '"' and last[-1] == '"') {
+	value++;
+	last--;
       }
-      cookie_t tmp;
-      tmp.value = value;
-      cookies.insert(cookie_tuple_t(key, tmp));
+      if(nameEnd != first)
+	received.emplace_back(std::string_view(first, nameEnd - first), std::string_view(value, last - value));
     }
   }
+
+  void Cookie::resetCookies(bool _response, const char* _cookies) {
+    cookies.clear();
+    received.clear();
+    source = NULL;
+    owned.clear();
+    response = _response;
+    if(_cookies)
+      parse(_cookies);
+  }
+
+  Cookie::Cookie(std::string _cookies) : source(NULL), owned(std::move(_cookies)), response (false) {
+    parse(owned.c_str());
+  }
+
+  const cookie_t* Cookie::tryGetCookie(Common::Key name) const {
+    cookie_dict_t::iterator i = cookies.find(std::string(name.getName()));
+    if(i != cookies.end())
+      return &i->second;
+    if(response)
+      return NULL;
+
+    // Built on first request, from then on served from cookies
+
+    std::optional<std::string_view> value = tryGetCookieValue(name);
+    if(not value)
+      return NULL;
+    cookie_t cookie;
+    cookie.value = *value;
+    return &cookies.insert(cookie_tuple_t(std::string(name.getName()), cookie)).first->second;
+  }
+
+  const Cookie::cookie_dict_t& Cookie::getCookies() const {
+    if(not response)
+      for(const std::pair<std::string_view, std::string_view>& sent : received) {
+	cookie_t cookie;
+	cookie.value = sent.second;
+	cookies.insert(cookie_tuple_t(std::string(sent.first), cookie)); // Keeps the first of duplicates and those built already
+      }
+    return cookies;
+  }
 }
@@ -0,0 +1,155 @@
+#include <cgi/cgi.hpp>
+#include <zlib.h>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <strings.h>
+
+/*! \file deflater.cpp
+  \brief Implementation of CGI::Deflater
+*/
+
+namespace CGI {
+
+  Deflater::Deflater() : format(IDENTITY), level(0), finished(false) {}
+
+  Deflater::~Deflater() {
+    if(format != IDENTITY)
+      deflateEnd(stream.get());
+  }
+
+  void Deflater::begin(format_t _format, int _level) {
+    finished = false;
+    if(_format == format and _level == level) {
+      deflateReset(stream.get());
+      return;
+    }
+    if(format != IDENTITY)
+      deflateEnd(stream.get());
+    else {
+      stream.reset(new z_stream);
+      buffer.reset(new char[BUFFER_SIZE]);
+    }
+
+    // windowBits 15 + 16 makes zlib write a gzip header and trailer instead of the zlib ones
+
+    *stream = z_stream();
+    format = IDENTITY;
+    if(deflateInit2(stream.get(), _level, Z_DEFLATED, _format == GZIP ? 15 + 16 : 15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+      throw Common::Exception("zlib could not be initialized", E_COMPRESSION_FAILED, __LINE__, __FILE__);
+    format = _format;
+    level = _level;
+  }
+
+  void Deflater::write(std::string_view data, mode_t mode, Sink& sink) {
+    if(finished) {
+      if(data.empty())
+	return;
+      throw Common::Exception("Compressed stream has already been ended", E_COMPRESSION_FAILED, __LINE__, __FILE__);
+    }
+    if(data.empty() and mode == CONTINUE)
+      return;
+
+    int flush = mode == FINISH ? Z_FINISH : Z_NO_FLUSH;
+    while(true) {
+      // avail_in is an unsigned int, larger data is fed in parts and only the last part is flushed
+
+      size_t part = std::min(data.size(), (size_t) UINT_MAX);
+      stream->next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+      stream->avail_in = part;
+      data.remove_prefix(part);
+      int partFlush = data.empty() ? (mode == SYNC ? Z_SYNC_FLUSH : flush) : Z_NO_FLUSH;
+
+      int status;
+      do {
+	stream->next_out = reinterpret_cast<Bytef*>(buffer.get());
+	stream->avail_out = BUFFER_SIZE;
+	status = deflate(stream.get(), partFlush);
+	if(status == Z_STREAM_ERROR)
+	  throw Common::Exception("zlib failed to compress the response", E_COMPRESSION_FAILED, __LINE__, __FILE__);
+	size_t produced = BUFFER_SIZE - stream->avail_out;
+	if(produced) {
+	  struct iovec iov;
+	  iov.iov_base = buffer.get();
+	  iov.iov_len = produced;
+	  sink.write(&iov, 1);
+	}
+      } while(stream->avail_out == 0 or stream->avail_in); // A full buffer means zlib may have more to give
+
+      if(data.empty())
+	break;
+    }
+    if(mode == FINISH)
+      finished = true;
+  }
+
+  /*
+   * Accept-Encoding is a list of codings with optional weights, e.g. "gzip;q=0.8, deflate, *;q=0" (RFC 7231 5.3.4).
+   * A coding not listed takes the weight of "*" if present, otherwise it is not acceptable. x-gzip is an alias of gzip.
+   */
+
+  Deflater::format_t Deflater::negotiate(const char* acceptEncoding) {
+    if(not acceptEncoding)
+      return IDENTITY;
+
+    double gzip = -1, deflate = -1, any = -1;
+    const char* p = acceptEncoding;
+    while(*p) {
+      while(*p == ' ' or *p == '\t' or *p == ',')
+	p++;
+      const char* token = p;
+      while(*p and *p != ',' and *p != ';' and *p != ' ' and *p != '\t')
+	p++;
+      size_t length = p - token;
+
+      double q = 1;
+      while(*p and *p != ',') {
+	if(*p == ';') {
+	  p++;
+	  while(*p == ' ' or *p == '\t')
+	    p++;
+	  if((*p == 'q' or *p == 'Q') and p[1] == '=')
+	    q = std::strtod(p + 2, NULL);
+	}
+	else
+	  p++;
+      }
+
+      if((length == 4 and not strncasecmp(token, "gzip", 4)) or (length == 6 and not strncasecmp(token, "x-gzip", 6)))
+	gzip = q;
+      else if(length == 7 and not strncasecmp(token, "deflate", 7))
+	deflate = q;
+      else if(length == 1 and *token == '*')
+	any = q;
+    }
+
+    if(gzip < 0)
+      gzip = any;
+    if(deflate < 0)
+      deflate = any;
+    if(gzip <= 0 and deflate <= 0)
+      return IDENTITY;
+    return gzip >= deflate ? GZIP : DEFLATE;
+  }
+
+  bool Deflater::compressible(std::string_view contentType) {
+    static const char* const compressed[] = {
+      "image/", "audio/", "video/", "font/woff", "application/zip", "application/gzip", "application/x-gzip",
+      "application/x-bzip2", "application/x-xz", "application/zstd", "application/x-7z-compressed",
+      "application/x-rar-compressed", "application/pdf", "application/octet-stream", NULL
+    };
+
+    size_t end = contentType.find(';');
+    std::string_view type = contentType.substr(0, end);
+    while(not type.empty() and (type.front() == ' ' or type.front() == '\t'))
+      type.remove_prefix(1);
+    if(type.size() >= 13 and not strncasecmp(type.data(), "image/svg+xml", 13))
+      return true; // The one image format which is text
+    for(const char* const* prefix = compressed; *prefix; prefix++) {
+      size_t length = std::strlen(*prefix);
+      if(type.size() >= length and not strncasecmp(type.data(), *prefix, length))
+	return false;
+    }
+    return true;
+  }
+}
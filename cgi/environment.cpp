@@ -0,0 +1,74 @@
+#include <cgi/cgi.hpp>
+#include <cstring>
+
+/*! \file environment.cpp
+  \brief Implementation of CGI::Environment
+*/
+
+namespace CGI {
+
+  // Names of Environment::hot_t variables, in the same order
+
+  static constexpr std::string_view hotNames[Environment::HOT_COUNT] = {
+    "QUERY_STRING",
+    "REQUEST_METHOD",
+    "CONTENT_LENGTH",
+    "CONTENT_TYPE",
+    "HTTP_COOKIE",
+    "HTTP_HOST",
+    "SERVER_NAME",
+    "HTTPS",
+    "HTTP_HTTPS",
+    "HTTP_ACCEPT_ENCODING",
+    "REQUEST_URI",
+  };
+
+  // Bit n is set if some hot_t variable has a name of length n, lets the scan skip most variables with one test
+
+  static constexpr uint32_t makeLengthMask() {
+    uint32_t mask = 0;
+    for(std::string_view name : hotNames)
+      mask |= 1U << name.size();
+    return mask;
+  }
+
+  static constexpr uint32_t lengthMask = makeLengthMask();
+
+  // Common::Key resolves these names to their hot_t index, which relies on them leading Common::knownKeys
+
+  static constexpr bool matchesKnownKeys() {
+    for(int k = 0; k < Environment::HOT_COUNT; k++)
+      if(hotNames[k] != Common::knownKeys[k])
+	return false;
+    return true;
+  }
+
+  static_assert(matchesKnownKeys(), "Common::knownKeys must start with the names of Environment::hot_t");
+
+  void Environment::reset(char** _envp) {
+    envp = _envp;
+    std::fill(hot, hot + HOT_COUNT, (const char*) NULL);
+
+    for(char** e = envp; e and *e; e++) {
+      const char* delimiter = std::strchr(*e, '=');
+      if(not delimiter)
+	continue;
+      std::string_view name (*e, delimiter - *e);
+      if(name.size() >= 32 or not (lengthMask >> name.size() & 1))
+	continue;
+      for(int k = 0; k < HOT_COUNT; k++)
+	if(hotNames[k] == name) {
+	  if(not hot[k])
+	    hot[k] = delimiter + 1;
+	  break;
+	}
+    }
+  }
+
+  const char* Environment::scan(std::string_view name) const {
+    for(char** e = envp; e and *e; e++)
+      if(std::strncmp(*e, name.data(), name.size()) == 0 and (*e)[name.size()] == '=')
+	return *e + name.size() + 1;
+    return NULL;
+  }
+}
@@ -1,7 +1,11 @@
 #include <cgi/cgi.hpp>
-#include <cctype>
-#include <set>
-#include <algorithm>
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 /*! \file functions.cpp
   \brief Implementation of functions in CGI namespace
@@ -9,59 +13,249 @@
 
 namespace CGI {
 
+  /*
+   * Characters to be encoded:
+   * 0-31, 128-255
+   * 36, 38, 43, 44, 47, 58, 59, 61, 63, 64, 127
+   * 32, 34, 60, 62, 35. 37, 123, 125, 124, 92
+   * 91, 93, 96, 126, 94
+   * See http://www.blooberry.com/indexdot/html/topics/urlencoding.htm
+   *
+   * That leaves alphanumerics and !'()*-._ which are emitted as they are.
+   */
+
+  static constexpr std::array<unsigned char, 256> makeHexTable() {
+    std::array<unsigned char, 256> t {};
+    for(int c = 0; c < 256; c++)
+      if(c >= '0' and c <= '9')
+	t[c] = c - '0';
+      else if(c >= 'A' and c <= 'F')
+	t[c] = c - 'A' + 10;
+      else if(c >= 'a' and c <= 'f')
+	t[c] = c - 'a' + 10;
+      else
+	t[c] = 0xFF;
+    return t;
+  }
+
+  static constexpr std::array<bool, 256> makeSafeTable() {
+    std::array<bool, 256> t {};
+    for(int c = 0; c < 256; c++)
+      t[c] = (c >= '0' and c <= '9') or (c >= 'A' and c <= 'Z') or (c >= 'a' and c <= 'z') or
+	c == '!' or (c >= '\'' and c <= '*') or c == '-' or c == '.' or c == '_';
+    return t;
+  }
+
+  const std::array<unsigned char, 256> hexValues = makeHexTable();
+  static constexpr std::array<bool, 256> safeTable = makeSafeTable();
+
+  /*
+   * plainPrefix() returns the number of leading bytes which are neither % nor +, safePrefix() the number of
+   * leading bytes which need not be escaped. Both process a vector register worth of bytes at a time and finish
+   * the tail using the tables.
+   * Signed comparisons are used for the ranges, bytes >= 128 are negative and hence fall outside all of them.
+   */
+
+#if defined(__AVX2__)
+
+  static inline __m256i inRange(__m256i v, char low, char high) {
+    return _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8(low - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8(high + 1), v));
+  }
+
+  static size_t plainPrefix(const char* p, size_t n) {
+    size_t i = 0;
+    for(; i + 32 <= n; i += 32) {
+      __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+      unsigned mask = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('%')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('+'))));
+      if(mask)
+	return i + __builtin_ctz(mask);
+    }
+    while(i < n and p[i] != '%' and p[i] != '+')
+      i++;
+    return i;
+  }
+
+  static size_t safePrefix(const char* p, size_t n) {
+    size_t i = 0;
+    for(; i + 32 <= n; i += 32) {
+      __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+      __m256i safe = _mm256_or_si256(inRange(v, '0', '9'), inRange(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), 'a', 'z'));
+      safe = _mm256_or_si256(safe, _mm256_or_si256(inRange(v, '\'', '*'), inRange(v, '-', '.')));
+      safe = _mm256_or_si256(safe, _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('!')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_'))));
+      unsigned mask = ~(unsigned) _mm256_movemask_epi8(safe);
+      if(mask)
+	return i + __builtin_ctz(mask);
+    }
+    while(i < n and safeTable[(unsigned char) p[i]])
+      i++;
+    return i;
+  }
+
+#elif defined(__SSE2__)
+
+  static inline __m128i inRange(__m128i v, char low, char high) {
+    return _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(low - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8(high + 1)));
+  }
+
+  static size_t plainPrefix(const char* p, size_t n) {
+    size_t i = 0;
+    for(; i + 16 <= n; i += 16) {
+      __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+      unsigned mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('%')), _mm_cmpeq_epi8(v, _mm_set1_epi8('+'))));
+      if(mask)
+	return i + __builtin_ctz(mask);
+    }
+    while(i < n and p[i] != '%' and p[i] != '+')
+      i++;
+    return i;
+  }
+
+  static size_t safePrefix(const char* p, size_t n) {
+    size_t i = 0;
+    for(; i + 16 <= n; i += 16) {
+      __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+      __m128i safe = _mm_or_si128(inRange(v, '0', '9'), inRange(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a', 'z'));
+      safe = _mm_or_si128(safe, _mm_or_si128(inRange(v, '\'', '*'), inRange(v, '-', '.')));
+      safe = _mm_or_si128(safe, _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('!')), _mm_cmpeq_epi8(v, _mm_set1_epi8('_'))));
+      unsigned mask = ~_mm_movemask_epi8(safe) & 0xFFFF;
+      if(mask)
+	return i + __builtin_ctz(mask);
+    }
+    while(i < n and safeTable[(unsigned char) p[i]])
+      i++;
+    return i;
+  }
+
+#else
+
+  static size_t plainPrefix(const char* p, size_t n) {
+    size_t i = 0;
+    while(i < n and p[i] != '%' and p[i] != '+')
+      i++;
+    return i;
+  }
+
+  static size_t safePrefix(const char* p, size_t n) {
+    size_t i = 0;
+    while(i < n and safeTable[(unsigned char) p[i]])
+      i++;
+    return i;
+  }
+
+#endif
+
+  size_t urldecode(char* data, size_t length) {
+    char *read = data, *write = data, *end = data + length;
+    while(read != end) {
+      size_t run = plainPrefix(read, end - read);
+      if(write != read)
+	std::memmove(write, read, run);
+      read += run;
+      write += run;
+      if(read == end)
+	break;
+
+      char c = *read++;
+      if(c == '+')
+	c = ' ';
+      else if(end - read >= 2 and hexValues[(unsigned char) read[0]] < 16 and hexValues[(unsigned char) read[1]] < 16) {
+	c = (char) (hexValues[(unsigned char) read[0]] << 4 | hexValues[(unsigned char) read[1]]);
+	read += 2;
+      }
+      *write++ = c;
+    }
+    return write - data;
+  }
+
+  std::string& urlencode(std::string_view data, std::string& out) {
+    static const char digits[] = "0123456789ABCDEF";
+    const char *p = data.data(), *end = p + data.size();
+
+    out.reserve(out.size() + data.size());
+    while(p != end) {
+      size_t run = safePrefix(p, end - p);
+      out.append(p, run);
+      p += run;
+      if(p == end)
+	break;
+
+      unsigned char c = *p++;
+      char escape[3] = {'%', digits[c >> 4], digits[c & 15]};
+      out.append(escape, 3);
+    }
+    return out;
+  }
+
+  static inline void twoDigits(char* out, unsigned value) {
+    out[0] = '0' + value / 10;
+    out[1] = '0' + value % 10;
+  }
+
+  size_t httpDate(time_t t, char* out) {
+    static const char days[] = "ThuFriSatSunMonTueWed"; // 1 January 1970 was a Thursday
+    static const char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+    static thread_local time_t cachedTime = -1;
+    static thread_local char cached[HTTP_DATE_LENGTH];
+
+    if(t != cachedTime) {
+      long long day = t / 86400, second = t % 86400;
+      if(second < 0) {
+	second += 86400;
+	day--;
+      }
+      unsigned weekday = ((day % 7) + 7) % 7;
+
+      // Civil date from days since the Epoch, the year is taken to start in March so that leap days come last
+
+      long long z = day + 719468, era = (z >= 0 ? z : z - 146096) / 146097;
+      unsigned dayOfEra = z - era * 146097;
+      unsigned yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+      unsigned dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+      unsigned shiftedMonth = (5 * dayOfYear + 2) / 153;
+      unsigned dayOfMonth = dayOfYear - (153 * shiftedMonth + 2) / 5 + 1;
+      unsigned month = shiftedMonth < 10 ? shiftedMonth + 2 : shiftedMonth - 10; // 0 is January
+      long long year = yearOfEra + era * 400 + (month < 2);
+
+      std::memcpy(cached, days + weekday * 3, 3);
+      cached[3] = ',';
+      cached[4] = ' ';
+      twoDigits(cached + 5, dayOfMonth);
+      cached[7] = ' ';
+      std::memcpy(cached + 8, months + month * 3, 3);
+      cached[11] = ' ';
+      twoDigits(cached + 12, year / 100 % 100);
+      twoDigits(cached + 14, year % 100);
+      cached[16] = ' ';
+      twoDigits(cached + 17, second / 3600);
+      cached[19] = ':';
+      twoDigits(cached + 20, second / 60 % 60);
+      cached[22] = ':';
+      twoDigits(cached + 23, second % 60);
+      std::memcpy(cached + 25, " GMT", 4);
+      cachedTime = t;
+    }
+    std::memcpy(out, cached, HTTP_DATE_LENGTH);
+    return HTTP_DATE_LENGTH;
+  }
+
   int decodeHex(std::string source) {
-    source.erase(0, 1); // Removing % from %XX
-    
-    unsigned int i = 0;
-    unsigned int j = source.size() - 1;
     int result = 0;
 
-    /*
-     * Convert the string to upper case
-     */
-    
-    std::transform(source.begin(), source.end(), source.begin(), (int (*)(int)) std::toupper);
-    // (int (*) (int)) added so that the proper toupper() in cctype is chosen instead of the one in locale.
-
-    for (i = 0; i < source.size(); i++, j--)
-      if (source.at(j) >= '0' and source.at(j) <= '9')
-	result += (source.at(j) - '0') * std::pow(16, i);
-      else if (source.at(j) >= 'A' and source.at(j) <= 'F')
-	result += ((source.at(j) - 'A') + 10) * std::pow(16, i); // eg: ('B' - 'A') + 10 = (66 - 65) + 10 = 11
-      else
-	throw Common::Exception("Invalid HEX symbol found in Common::decodeHex", E_INVALID_HEX_SYMBOL);
+    // Skipping % from %XX
+
+    for(size_t i = (source.size() and source[0] == '%') ? 1 : 0; i < source.size(); i++) {
+      unsigned char digit = hexValues[(unsigned char) source[i]];
+      if(digit > 15)
+	throw Common::Exception("Invalid HEX symbol found in Common::decodeHex", E_INVALID_HEX_SYMBOL, __LINE__, __FILE__);
+      result = result << 4 | digit;
+    }
     return result;
   }
 
   std::string& encodeHex(std::string& source) {
-    /*
-     * Characters to be encoded:
-     * 0-31, 128-255
-     * 36, 38, 43, 44, 47, 58, 59, 61, 63, 64, 127
-     * 32, 34, 60, 62, 35. 37, 123, 125, 124, 92
-     * 91, 93, 96, 126, 94
-     * See http://www.blooberry.com/indexdot/html/topics/urlencoding.htm
-     */
-    size_t i;
-    int array[] = {43, 44, 47, 63, 64, 96};
-    std::set <int> toBeReplaced (array, array + 5);
-    for(i = 0; i < source.size(); i++) {
-      /*
-       * Encode the first set of characters, stated above
-       */
-      char current = source.at(i);
-      if(current <= 32 or
-	 (current >= 34 and current <= 38) or
-	 (current >= 58 and current <= 61) or
-	 (current >= 91 and current <= 94) or
-	 current >= 123 or
-	 toBeReplaced.count(current)) {
-	  char *tmp = new char[4]; // %XX + NUL
-	  std::sprintf(tmp, "%X", (int) current);
-	  source.replace(i, 1, tmp);
-	  delete [] tmp;
-      }
-    }
+    std::string encoded;
+    urlencode(source, encoded);
+    source.swap(encoded);
     return source;
   }
 }
@@ -0,0 +1,216 @@
+#include <cgi/cgi.hpp>
+#include <cstring>
+#include <strings.h>
+
+/*! \file multipart.cpp
+  \brief Implementation of CGI::Multipart
+*/
+
+namespace CGI {
+
+  static const size_t MAX_HEADERS = 16384; // Largest header block of a part we are willing to buffer
+
+  static std::string_view trim(std::string_view s) {
+    while(s.size() and (s.front() == ' ' or s.front() == '\t'))
+      s.remove_prefix(1);
+    while(s.size() and (s.back() == ' ' or s.back() == '\t'))
+      s.remove_suffix(1);
+    return s;
+  }
+
+  static bool iequals(std::string_view a, std::string_view b) {
+    return a.size() == b.size() and strncasecmp(a.data(), b.data(), a.size()) == 0;
+  }
+
+  /*
+   * Splits parameters of a header value (Content-Type, Content-Disposition) and calls f(key, value) for each of them.
+   * Values may be quoted, backslash escapes inside quotes are resolved.
+   */
+
+  template<typename F>
+  static void eachParameter(std::string_view header, F f) {
+    size_t i = header.find(';');
+    while(i != std::string_view::npos and i < header.size()) {
+      i++;
+      size_t eq = header.find('=', i);
+      if(eq == std::string_view::npos)
+	break;
+      std::string_view key = trim(header.substr(i, eq - i));
+      std::string value;
+      i = eq + 1;
+      while(i < header.size() and (header[i] == ' ' or header[i] == '\t'))
+	i++;
+      if(i < header.size() and header[i] == '"') {
+	for(i++; i < header.size() and header[i] != '"'; i++) {
+	  if(header[i] == '\\' and i + 1 < header.size())
+	    i++;
+	  value += header[i];
+	}
+	i = header.find(';', i);
+      }
+      else {
+	size_t end = header.find(';', i);
+	value = trim(header.substr(i, end == std::string_view::npos ? std::string_view::npos : end - i));
+	i = end;
+      }
+      f(key, value);
+    }
+  }
+
+  Multipart::Multipart(std::string_view boundary, Handler& _handler) : handler(_handler), state(PREAMBLE) {
+    delimiter = "\r\n--";
+    delimiter += boundary;
+
+    // The first boundary need not be preceded by CRLF, pretending that the body starts with one takes care of it
+
+    window = "\r\n";
+
+    size_t length = delimiter.size();
+    for(size_t c = 0; c < 256; c++)
+      skip[c] = length;
+    for(size_t i = 0; i + 1 < length; i++)
+      skip[(unsigned char) delimiter[i]] = length - 1 - i;
+  }
+
+  size_t Multipart::search(size_t from) const {
+    size_t length = delimiter.size();
+    const char *needle = delimiter.data(), *hay = window.data();
+    unsigned char last = needle[length - 1];
+
+    for(size_t i = from; i + length <= window.size(); ) {
+      unsigned char c = hay[i + length - 1];
+      if(c == last and std::memcmp(hay + i, needle, length - 1) == 0)
+	return i;
+      i += skip[c];
+    }
+    return std::string::npos;
+  }
+
+  void Multipart::parseHeaders(size_t from, size_t to) {
+    part = part_t();
+    while(from < to) {
+      size_t eol = window.find("\r\n", from);
+      if(eol == std::string::npos or eol > to)
+	eol = to;
+      std::string_view line (window.data() + from, eol - from);
+      from = eol + 2;
+
+      size_t colon = line.find(':');
+      if(colon == std::string_view::npos)
+	continue;
+      std::string_view name = trim(line.substr(0, colon)), value = trim(line.substr(colon + 1));
+      if(iequals(name, "Content-Disposition"))
+	eachParameter(value, [this](std::string_view key, const std::string& v) {
+	    if(iequals(key, "name"))
+	      part.name = v;
+	    else if(iequals(key, "filename"))
+	      part.filename = v;
+	  });
+      else if(iequals(name, "Content-Type"))
+	part.contentType = value;
+    }
+  }
+
+  void Multipart::feed(const char* data, size_t length) {
+    size_t pos = 0, found;
+    window.append(data, length);
+
+    for(bool more = true; more; ) {
+      switch(state) {
+      case PREAMBLE:
+      case BODY:
+	if((found = search(pos)) == std::string::npos) {
+
+	  // Everything except a possible prefix of the delimiter at the end can be handed over
+
+	  size_t keep = delimiter.size() - 1;
+	  if(window.size() - pos > keep) {
+	    size_t n = window.size() - pos - keep;
+	    if(state == BODY)
+	      handler.data(window.data() + pos, n);
+	    pos += n;
+	  }
+	  more = false;
+	  break;
+	}
+	if(state == BODY) {
+	  handler.data(window.data() + pos, found - pos);
+	  handler.end();
+	}
+	pos = found + delimiter.size();
+	state = DELIMITER;
+	break;
+
+      case DELIMITER:
+
+	// Delimiter is followed either by -- (close delimiter) or by optional whitespace and CRLF
+
+	if(window.size() - pos < 2) {
+	  more = false;
+	  break;
+	}
+	if(window.compare(pos, 2, "--") == 0) {
+	  state = DONE;
+	  break;
+	}
+	if((found = window.find("\r\n", pos)) == std::string::npos) {
+	  if(window.size() - pos > MAX_HEADERS)
+	    throw Common::Exception("Invalid multipart/form-data boundary line", E_MULTIPART_INVALID, __LINE__, __FILE__);
+	  more = false;
+	  break;
+	}
+	pos = found + 2;
+	state = HEADERS;
+	break;
+
+      case HEADERS:
+	if(window.compare(pos, 2, "\r\n") == 0)
+	  found = pos; // Part without headers
+	else if((found = window.find("\r\n\r\n", pos)) == std::string::npos) {
+	  if(window.size() - pos > MAX_HEADERS)
+	    throw Common::Exception("multipart/form-data part headers are too large", E_MULTIPART_INVALID, __LINE__, __FILE__);
+	  more = false;
+	  break;
+	}
+	else
+	  found += 2;
+	parseHeaders(pos, found);
+	handler.begin(part);
+	pos = found + 2;
+	state = BODY;
+	break;
+
+      case DONE:
+	pos = window.size(); // Epilogue is ignored
+	more = false;
+	break;
+      }
+    }
+    window.erase(0, pos);
+  }
+
+  void Multipart::finish() {
+    if(state != DONE)
+      throw Common::Exception("multipart/form-data body is truncated", E_MULTIPART_INVALID, __LINE__, __FILE__);
+  }
+
+  std::string_view Multipart::getBoundary(std::string_view contentType) {
+    static const std::string_view type = "multipart/form-data";
+    if(contentType.size() < type.size() or not iequals(contentType.substr(0, type.size()), type))
+      return std::string_view();
+
+    size_t i = contentType.find(';');
+    while(i != std::string_view::npos) {
+      size_t end = contentType.find(';', i + 1);
+      std::string_view parameter = trim(contentType.substr(i + 1, end == std::string_view::npos ? end : end - i - 1));
+      if(parameter.size() > 9 and iequals(parameter.substr(0, 9), "boundary=")) {
+	parameter.remove_prefix(9);
+	if(parameter.size() >= 2 and parameter.front() == '"' and parameter.back() == '"')
+	  parameter = parameter.substr(1, parameter.size() - 2);
+	return parameter.size() <= 70 ? parameter : std::string_view(); // RFC 2046 limits boundaries to 70 characters
+      }
+      i = end;
+    }
+    return std::string_view();
+  }
+}
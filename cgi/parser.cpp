@@ -1,7 +1,7 @@
 #include <cgi/cgi.hpp>
 
 /*! \file parser.cpp
-  \brief Implementation of CGI::Parser
+  \brief Implementation of CGI::Parser and CGI::Tokenizer
 */
 
 namespace CGI {
@@ -15,67 +15,55 @@ namespace CGI {
    * because it should be inlined, it conatins just one function call to setQstr()
    */
 
-  void Parser::_sanitize(std::string& s, size_t n) const {
-    size_t i;
-    for (i = n; i < s.size(); i++) {
-      if (s.at(i) == '&' or s.at(i) == '=' or s.at(i) == ';') {
-	if (i == 0) break;
-	if (s.at(i-1) == '&' or s.at(i-1) == '=' or s.at(i-1) == ';') {
-	  s.erase(i,1);
-	  _sanitize(s,i);
+  bool Tokenizer::next(std::string_view& key, std::string_view& value) {
+    while(cursor != end) {
+      char *start = cursor, *write = cursor, *separator = NULL;
+
+      /*
+       * Decoding writes at most as many bytes as it reads, hence the decoded pair is compacted
+       * to the front of its own span and never overwrites bytes that are yet to be read.
+       */
+
+      while(cursor != end and *cursor != '&' and *cursor != ';') {
+	char c = *cursor++;
+	if(c == '=' and not separator) {
+	  separator = write;
+	  continue;
 	}
+	if(c == '+')
+	  c = ' ';
+	else if(c == '%' and end - cursor >= 2) {
+	  unsigned char high = hexValues[(unsigned char) cursor[0]], low = hexValues[(unsigned char) cursor[1]];
+	  if(high < 16 and low < 16) { // Malformed escapes are kept as they are
+	    c = (char) (high << 4 | low);
+	    cursor += 2;
+	  }
+	}
+	*write++ = c;
       }
+      if(cursor != end)
+	cursor++; // Skip the pair delimiter
+
+      if(not separator)
+	separator = write;
+      if(separator == start) // Empty pair or empty key
+	continue;
+      key = std::string_view(start, separator - start);
+      value = std::string_view(separator, write - separator);
+      return true;
     }
-        
-    while (s.at(0) == '=' or s.at(0) == '&' or s.at(0) == ';')
-      s.erase(0,1);
-      
-    while (s.at(s.size()-1) == '=' or s.at(s.size()-1) == '&' or s.at(s.size()-1) == ';')
-      s.erase(s.size()-1,1);
+    return false;
   }
 
-  Dict_ptr_t Parser::parse() const {    
-    std::string copy = getQstr(), extract = "";
-    _sanitize(copy);
-
-    size_t delimiter = std::string::npos;
+  Dict_ptr_t Parser::parse() const {
+    std::string copy = getQstr();
+    Tokenizer tokens (&copy[0], copy.size());
+    std::string_view key, value;
     Dict_ptr_t ret (new Dict_t);
-    std::string key = "", value = "";
-
-    while(copy.size()) {
-      if((delimiter = copy.find('&')) != std::string::npos or
-	 (delimiter = copy.find(';')) != std::string::npos) {
-	extract = copy.substr(0, delimiter);
-	copy.erase(0, delimiter + 1);
-      }
-      else {
-	extract = copy;
-	copy.clear();
-      }
-      if((delimiter = extract.find('=')) != std::string::npos) {
-	key  = extract.substr(0, delimiter);
-	value = extract.substr(delimiter + 1);
-	extract.clear();
-      }
-      else {
-	key = extract;
-	value = "";
-	extract.clear();
-      }
-      if((delimiter = key.find('%')) != std::string::npos)
-	key.replace(delimiter, delimiter + 3, 1, decodeHex(key.substr(delimiter, delimiter + 3)));
 
-      /*
-       * For some strange reason value.find() returns pos + 1 for position for %
-       * Hence a hack has been added here. If troublesome, remove -1 and change 4 to 3.
-       */
-      
-      if((delimiter = value.find('%') != std::string::npos))
-	value.replace(delimiter-1, delimiter + 4, 1, decodeHex(value.substr(delimiter-1, delimiter + 4)));
-      
-      ret->insert(Tuple_t(key, value));
-    }
+    while(tokens.next(key, value))
+      ret->insert(Tuple_t(std::string(key), std::string(value)));
     return ret;
   }
-  
+
 }
@@ -1,8 +1,11 @@
 #include <cgi/cgi.hpp>
 #include <cstdio>
 #include <cstring>
-#include <algorithm>
-#include <fcgi_stdio.h>
+#include <strings.h>
+#include <cerrno>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/mman.h>
 
 /*! \file request.cpp
   \brief Implementation of CGI::Request
@@ -10,121 +13,300 @@
 
 namespace CGI {
 
-  Request::Request(char **envp) : postBuffer(NULL), postBuffer_fncall(NULL), rawpostdata(false) {    
+  Request::Request(char **envp, FCGX_Stream *in) : Session(std::string()), rawpostdata(false), postBuffer(NULL), postMapped(false), contentLength(0) {
+    reset(envp, in);
+  }
 
-    //Parse **env into dict_t env (private variable)
+  void Request::reset(char **envp, FCGX_Stream *in) {
 
-    while(*envp) {
-      std::string tmp = *envp;
-      size_t delimiter = tmp.find('=');
-      env[tmp.substr(0, delimiter)] = tmp.substr(delimiter + 1);
-      envp++;
-    }
+    // Forget the previous request. clear() retains the memory of the dictionaries and strings
+
+    get.clear();
+    post.clear();
+    queryBuffer.clear();
+    rawpostdata = false;
+    releasePost();
+    contentLength = 0;
+    body.reset(0, in);
+    boundary = std::string_view();
+    postStrings.clear();
+    for(std::vector<file_t>::iterator i = files.begin(); i != files.end(); i++)
+      unlink(i->path.c_str());
+    files.clear();
+
+    // env only indexes envp, nothing is copied
 
-    if(getParam("QUERY_STRING", ENV).size())
-      get = *(Parser(getParam("QUERY_STRING", ENV)).parse()); // Parse the input query string into dict.      
+    env.reset(envp);
 
-    std::string reqmethod = getParam("REQUEST_METHOD", ENV);
-    std::transform(reqmethod.begin(), reqmethod.end(), reqmethod.begin(), (int (*)(int)) std::toupper); // Convert to uppercase
+    resetCookies(false, env.get(Environment::HTTP_COOKIE));
+    std::optional<std::string_view> session = tryGetCookieValue(Common::Registry::getService<Common::Config>().getParam(Common::Keys::SESS_COOKIENAME));
+    if(session)
+      resume(std::string(*session)); // Loaded on first access
+    else
+      renew(); // No session cookie
 
-    if(reqmethod == "POST") {
+    std::string_view key, value;
+    const char *var;
 
-      // As per CGI specifications, HTTP POST data is available in stdin.
+    if((var = env.get(Environment::QUERY_STRING)) and *var) {
+      queryBuffer = var;
+      Tokenizer tokens (&queryBuffer[0], queryBuffer.size()); // Parse the input query string into dict.
+      while(tokens.next(key, value))
+	get.insert(key, value);
+    }
+
+    if((var = env.get(Environment::REQUEST_METHOD)) and strcasecmp(var, "POST") == 0) {
 
-      size_t length = 0;
-      std::sscanf(getParam("CONTENT_LENGTH", ENV).c_str(), "%zu", &length); // %zu - size_t
+      // As per CGI specifications, HTTP POST data is available in stdin. It is read through body (BodyStream).
 
-      if(not length)
+      if((var = env.get(Environment::CONTENT_LENGTH)))
+	std::sscanf(var, "%zu", &contentLength); // %zu - size_t
+
+      if(not contentLength)
 	throw Common::Exception("Invalid CONTENT_LENGTH", E_INVALID_CONTENT_LENGTH, __LINE__, __FILE__);
       
-      char *buf = new char[length];
+      body.reset(contentLength, in);
+      if((var = env.get(Environment::CONTENT_TYPE)) and std::strncmp(var, "application/x-www-form-urlencoded", 33) != 0) {
+
+	// multipart/form-data is parsed on demand (see parsePending), anything else is binary and left in stdin
 
-      for(size_t c = 0; c < length; c++)
-	buf[c] = getchar();
-      try {
-	if(getParam("CONTENT_TYPE", ENV).compare("application/x-www-form-urlencoded") != 0) { // Submitted data is binary
-	  postBuffer = buf;
+	if((boundary = Multipart::getBoundary(var)).empty())
 	  rawpostdata = true;
-	}
-      } catch(Common::Exception e) {
-	if(e != E_PARAM_NOT_FOUND)
-	  throw e;
-	else
-	  post = *(CGI::Parser(buf).parse());
       }
-    }
-    
-    try {
-      Cookie(getParam("HTTP_COOKIE", ENV));
-      Common::Registry &reg = Common::Registry::getInstance();
-      Common::Config &conf = reg.getItem<Common::Config>("config");      
-      Session(getCookie(conf.getParam("sess_cookiename").c_str()).value);
-    }
-    catch(Common::Exception e) {
-      if(e != E_PARAM_NOT_FOUND)
-	throw e;
+      else {
+	readPost();
+	Tokenizer tokens (postBuffer, contentLength);
+	while(tokens.next(key, value))
+	  post.insert(key, value);
+      }
     }
   }
 
   Dict_ptr_t Request::getData(unsigned option) {
-    Dict_t::iterator i;
+    Common::FlatDict::iterator i;
     Dict_ptr_t ret (new Dict_t);
     if(option & GET)
       for(i = get.begin(); i != get.end(); i++)
-	ret->insert(*i);
+	ret->insert(Tuple_t(std::string(i->first), std::string(i->second)));
     if(option & POST) {
       if(rawpostdata)
 	throw Common::Exception("Error: POST data is binary, use getbinPost()", E_POST_BINARY, __LINE__, __FILE__);
+      parsePending();
       for(i = post.begin(); i != post.end(); i++)
-	ret->insert(*i);
+	ret->insert(Tuple_t(std::string(i->first), std::string(i->second)));
     }    
     if(option & SESSION) {
-      Dict_ptr_t ss = Session::getData();
-      for(i = ss->begin(); i != ss->end(); i++)
-	ret->insert(*i);
+      Common::PersistentDict ss = Session::getData();
+      for(Common::PersistentDict::const_iterator j = ss.begin(); j != ss.end(); ++j)
+	ret->insert(*j);
     }
     if(option & ENV)
-      for(i = env.begin(); i != env.end(); i++)
-	ret->insert(*i);
+      for(char **e = env.getEnvp(); e and *e; e++) {
+	const char *delimiter = std::strchr(*e, '=');
+	if(delimiter)
+	  ret->insert(Tuple_t(std::string(*e, delimiter - *e), delimiter + 1));
+      }
     return ret;
   }
 
   // option below is an optional parameter. See request.hpp
 
-  std::string Request::getParam(std::string name, unsigned option) {
+  std::optional<std::string_view> Request::tryGetParam(Common::Key name, unsigned option) {
 
     // Order preference - GPSE.
     
-    Dict_t::iterator i;    
-    if((option & GET) and ((i = get.find(name)) != get.end()))
+    Common::FlatDict::iterator i;
+    if((option & GET) and ((i = get.find(name.getName(), name.getHash())) != get.end()))
       return i->second;
     if(option & POST) {
       if(rawpostdata)
 	throw Common::Exception("Error: POST data is binary", E_POST_BINARY, __LINE__, __FILE__);
-      return i->second;
+      parsePending();
+      if((i = post.find(name.getName(), name.getHash())) != post.end())
+	return i->second;
     }
-    if(option & SESSION)
-      return Session::getParam(name);
-    if((option & ENV) and ((i = env.find(name)) != env.end()))
-      return i->second;    
-    throw Common::Exception("Request parameter " + name + " not found in GET, POST data and environment variables", E_PARAM_NOT_FOUND, __LINE__, __FILE__);
+    const std::string* value;
+    if((option & SESSION) and (value = Session::tryGetParam(name)))
+      return *value;
+    const char *var;
+    if((option & ENV) and (var = env.find(name)))
+      return var;
+    return std::nullopt;
   }
 
-  Request::~Request() {
-    if(postBuffer)
+  std::string Request::getParam(Common::Key name, unsigned option) {
+    std::optional<std::string_view> value = tryGetParam(name, option);
+    if(value)
+      return std::string(*value);
+    throw Common::Exception("Request parameter " + std::string(name.getName()) + " not found in GET, POST data and environment variables", E_PARAM_NOT_FOUND, __LINE__, __FILE__);
+  }
+
+  namespace {
+
+    const size_t MAX_FIELDS = 1048576; // Total size of the text fields of a form we are willing to hold in memory
+
+    /*
+     * Receives the parts of a multipart/form-data body on behalf of Request. Text fields are collected into strings
+     * and added to post, file parts are handed to the user's handler or spilled to temporary files if there is none.
+     */
+
+    class FormHandler : public Multipart::Handler {
+    private:
+      std::deque<std::string>& strings;
+      Common::FlatDict& post;
+      std::vector<file_t>& files;
+      Multipart::Handler* user;
+      enum { TEXT, SPILL, USER } target;
+      std::string *name, *value;
+      size_t fields; // Bytes held by the text fields so far
+      int fd;
+
+    public:
+      FormHandler(std::deque<std::string>& _strings, Common::FlatDict& _post, std::vector<file_t>& _files, Multipart::Handler* _user) :
+	strings(_strings), post(_post), files(_files), user(_user), target(TEXT), name(NULL), value(NULL), fields(0), fd(-1) {}
+
+      ~FormHandler() {
+	if(fd >= 0)
+	  close(fd);
+      }
+
+      void begin(const part_t& part) {
+	if(part.filename.empty()) {
+	  target = TEXT;
+	  strings.push_back(part.name); // References to elements of a deque stay valid when it grows
+	  name = &strings.back();
+	  strings.push_back(std::string());
+	  value = &strings.back();
+	}
+	else if(user) {
+	  target = USER;
+	  user->begin(part);
+	}
+	else {
+	  target = SPILL;
+	  file_t f;
+	  f.name = part.name;
+	  f.filename = part.filename;
+	  f.contentType = part.contentType;
+	  f.path = P_tmpdir "/cxxcms-upload-XXXXXX";
+	  if((fd = mkstemp(&f.path[0])) < 0)
+	    throw Common::Exception("Unable to create a temporary file for upload " + part.filename, E_UPLOAD_FAILED, __LINE__, __FILE__);
+	  files.push_back(f);
+	}
+      }
+
+      void data(const char* data, size_t length) {
+	if(target == TEXT) {
+	  if((fields += length) > MAX_FIELDS) // Uploads without a filename would otherwise be held in memory, whatever their size
+	    throw Common::Exception("multipart/form-data text fields are too large", E_MULTIPART_INVALID, __LINE__, __FILE__);
+	  value->append(data, length);
+	}
+	else if(target == USER)
+	  user->data(data, length);
+	else {
+	  files.back().size += length;
+	  while(length) {
+	    ssize_t written = write(fd, data, length);
+	    if(written < 0 and errno == EINTR)
+	      continue;
+	    if(written <= 0)
+	      throw Common::Exception("Unable to write upload to " + files.back().path, E_UPLOAD_FAILED, __LINE__, __FILE__);
+	    data += written;
+	    length -= written;
+	  }
+	}
+      }
+
+      void end() {
+	if(target == TEXT)
+	  post.insert(*name, *value);
+	else if(target == USER)
+	  user->end();
+	else {
+	  close(fd);
+	  fd = -1;
+	}
+      }
+    };
+  }
+
+  void Request::parsePending(Multipart::Handler* handler) {
+    if(boundary.empty())
+      return;
+
+    FormHandler form (postStrings, post, files, handler);
+    Multipart parser (boundary, form);
+    const char *chunk;
+    size_t n;
+
+    boundary = std::string_view(); // Parsed only once, even if it fails
+    checkLength(contentLength);
+    while((n = body.next(chunk)))
+      parser.feed(chunk, n);
+    parser.finish();
+  }
+
+  Request& Request::parseMultipart(Multipart::Handler& handler) {
+    if(boundary.empty())
+      throw Common::Exception("Error: POST data is not multipart/form-data or was already parsed", E_POST_NOT_BINARY, __LINE__, __FILE__);
+    parsePending(&handler);
+    return *this;
+  }
+
+  void Request::checkLength(size_t length) const {
+    std::string_view limit = Common::Registry::getService<Common::Config>().getParam(Common::Keys::REQUEST_MAX_BODY);
+    if(length > (limit.empty() ? MAX_BODY : std::strtoull(limit.data(), NULL, 10)))
+      throw Common::Exception("POST data of " + std::to_string(length) + " bytes exceeds request_max_body", E_BODY_TOO_LARGE, __LINE__, __FILE__);
+  }
+
+  void Request::allocatePost(size_t length) {
+    checkLength(length);
+    if(length >= MAP_THRESHOLD) {
+      void *p = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if(p != MAP_FAILED) {
+	postBuffer = static_cast<char*>(p);
+	postMapped = true;
+	return;
+      }
+    }
+    postBuffer = new char[length];
+    postMapped = false;
+  }
+
+  void Request::readPost() {
+    allocatePost(contentLength);
+    try {
+      body.read(postBuffer, contentLength);
+    }
+    catch(...) { // A partly read buffer would be taken for the body by a later call
+      releasePost();
+      throw;
+    }
+  }
+
+  void Request::releasePost() {
+    if(postMapped)
+      munmap(postBuffer, contentLength);
+    else if(postBuffer)
       delete[] postBuffer;
-    if(postBuffer_fncall)
-      delete[] postBuffer_fncall;
-    postBuffer = postBuffer_fncall = NULL;
+    postBuffer = NULL;
+    postMapped = false;
   }
 
-  char* Request::getBinPost() {
+  Request::~Request() {
+    for(std::vector<file_t>::iterator i = files.begin(); i != files.end(); i++)
+      unlink(i->path.c_str());
+    releasePost();
+  }
+
+  std::string_view Request::getBinPost() {
     if(not rawpostdata)
       throw Common::Exception("Error: POST data is not binary", E_POST_NOT_BINARY, __LINE__, __FILE__);
-    size_t len = 0;
-    std::sscanf(getParam("CONTENT_LENGTH", ENV).c_str(), "%zu", &len);
-    postBuffer_fncall = new char[len];
-    std::memcpy(postBuffer_fncall, postBuffer, len);
-    return postBuffer_fncall;
+    if(not postBuffer) {
+      if(body.getRemaining() != contentLength)
+	throw Common::Exception("Error: POST data was already read using getBodyStream()", E_BODY_CONSUMED, __LINE__, __FILE__);
+      readPost();
+    }
+    return std::string_view(postBuffer, contentLength);
   }
 }
@@ -4,8 +4,8 @@
 
 #include <cgi/cgi.hpp>
 #include <ctime>
-#include <clocale>
 #include <cstring>
+#include <cstdint>
 
 namespace CGI {
   std::unique_ptr<char[]> Response::getBinaryBody() {
@@ -13,8 +13,8 @@ namespace CGI {
       throw Common::Exception("Response is not binary", E_RESPONSE_NOT_BINARY, __LINE__, __FILE__);
     setupHeaders();
     std::unique_ptr<char[]> ret (new char[headerString.size() + binaryLength]);
-    std::strcpy(ret.get(), headerString.c_str());
-    std::strcat(ret.get(), binaryData.get());
+    std::memcpy(ret.get(), headerString.data(), headerString.size());
+    std::memcpy(ret.get() + headerString.size(), binaryData.get(), binaryLength); // Binary data may contain NUL
     return ret;
   }
 
@@ -22,20 +22,161 @@ namespace CGI {
     if(binary)
       throw Common::Exception("Response is binary", E_RESPONSE_BINARY, __LINE__, __FILE__);      
     setupHeaders();
-    completeBody = headerString + contentBody;
+    completeBody.assign(headerString).append(contentBody);
     return completeBody;
   }
 
-  std::string Response::getParam(std::string name, option_t option) {    
-    Dict_t::iterator i;
-    if(option == HEADER) {
-      i = headers.find(name);
-      if(i == headers.end())
-	throw Common::Exception("Parameter: " + name + " not found in headers", E_PARAM_NOT_FOUND, __LINE__, __FILE__);
-      return i->second;
+  const Request& Response::getRequest() const {
+    return request ? *request : Common::Registry::getInstance().getItem<CGI::Request>(Common::Keys::REQUEST);
+  }
+
+  std::string* Response::findHeader(Common::Key name) {
+    int slot = name.getSlot() - Common::KNOWN_HEADERS;
+    if(slot >= 0)
+      return knownHeaderMask & (1U << slot) ? &knownHeaders[slot] : NULL;
+    Dict_t::iterator i = headers.find(std::string(name.getName()));
+    return i == headers.end() ? NULL : &i->second;
+  }
+
+  std::string& Response::header(Common::Key name) {
+    int slot = name.getSlot() - Common::KNOWN_HEADERS;
+    if(slot < 0)
+      return headers[std::string(name.getName())];
+    if(not (knownHeaderMask & (1U << slot))) {
+      knownHeaderMask |= 1U << slot;
+      knownHeaders[slot].clear();
     }
+    return knownHeaders[slot];
+  }
+
+  void Response::dropHeader(Common::Key name) {
+    int slot = name.getSlot() - Common::KNOWN_HEADERS;
+    if(slot >= 0)
+      knownHeaderMask &= ~(1U << slot);
+    else
+      headers.erase(std::string(name.getName()));
+  }
+
+  void Response::chooseEncoding(size_t size) {
+    encoding = Deflater::IDENTITY;
+    if(cached or not compressionLevel or size < compressionMin or findHeader(Common::Keys::CONTENT_ENCODING))
+      return;
+    const std::string* type = findHeader(Common::Keys::CONTENT_TYPE);
+    if(type and not Deflater::compressible(*type))
+      return;
+
+    // The response now depends on Accept-Encoding, caches must know that even if it is sent as it is
+
+    std::string& vary = header(Common::Keys::VARY);
+    vary.append(vary.empty() ? "Accept-Encoding" : ", Accept-Encoding");
+
+    encoding = Deflater::negotiate(getRequest().getEnv(Environment::HTTP_ACCEPT_ENCODING));
+    if(encoding == Deflater::IDENTITY)
+      return;
+    header(Common::Keys::CONTENT_ENCODING) = encoding == Deflater::GZIP ? "gzip" : "deflate";
+    dropHeader(Common::Keys::CONTENT_LENGTH); // A length set by the handler is that of the uncompressed body
+    if(not deflater)
+      deflater.reset(new Deflater);
+    deflater->begin(encoding, compressionLevel);
+  }
+
+  void Response::send(Sink& sink, std::string_view first, std::string_view second, Deflater::mode_t mode) {
+    struct iovec iov[3];
+    int count = 0;
+    if(not headersSent) {
+      chooseEncoding(mode == Deflater::FINISH ? first.size() + second.size() : SIZE_MAX);
+      setupHeaders();
+      iov[count].iov_base = &headerString[0];
+      iov[count++].iov_len = headerString.size();
+      headersSent = true;
+    }
+
+    if(encoding == Deflater::IDENTITY) {
+      if(not first.empty()) {
+	iov[count].iov_base = const_cast<char*>(first.data());
+	iov[count++].iov_len = first.size();
+      }
+      if(not second.empty()) {
+	iov[count].iov_base = const_cast<char*>(second.data());
+	iov[count++].iov_len = second.size();
+      }
+      if(count)
+	sink.write(iov, count);
+    }
+    else {
+      if(count)
+	sink.write(iov, count);
+      deflater->write(first, Deflater::CONTINUE, sink);
+      deflater->write(second, mode, sink);
+    }
+  }
+
+  Response& Response::setCached(ResponseCache::entry_ptr_t entry) {
+    if(headersSent)
+      throw Common::Exception("Cached body cannot be sent, headers were already sent", E_HEADERS_SENT, __LINE__, __FILE__);
+    clearBody();
+    binary = false;
+    header(Common::Keys::CONTENT_TYPE) = entry->contentType;
+    cached = entry;
+    return *this;
+  }
+
+  Response& Response::flush(Sink& sink, bool last) {
+    if(cached) {
+      std::string_view body = cached->body;
+      if(not headersSent and not cached->gzip.empty() and not findHeader(Common::Keys::CONTENT_ENCODING)) {
+	std::string& vary = header(Common::Keys::VARY);
+	vary.append(vary.empty() ? "Accept-Encoding" : ", Accept-Encoding");
+	if(Deflater::negotiate(getRequest().getEnv(Environment::HTTP_ACCEPT_ENCODING)) == Deflater::GZIP) {
+	  header(Common::Keys::CONTENT_ENCODING) = "gzip";
+	  body = cached->gzip;
+	  if(std::string* length = findHeader(Common::Keys::CONTENT_LENGTH)) // Set by the handler for the stored body
+	    *length = std::to_string(body.size());
+	}
+      }
+      send(sink, body, std::string_view(), Deflater::FINISH); // Sent as stored, see chooseEncoding
+      contentBody.clear();
+      cached.reset();
+      return *this;
+    }
+
+    std::string_view body;
+    if(binary and binaryData)
+      body = std::string_view(binaryData.get(), binaryLength);
+    else if(not binary)
+      body = contentBody;
+    send(sink, body, std::string_view(), last ? Deflater::FINISH : Deflater::SYNC);
+    if(binary)
+      binaryData.reset(); // Sent, it must not be sent again by a later flush
+    contentBody.clear();
+    return *this;
+  }
+
+  void Response::drain(std::string_view more, size_t keep) {
+    size_t total = contentBody.size() + more.size();
+    if(keep > total)
+      keep = total;
+    size_t fromBody = std::min(total - keep, contentBody.size()), fromMore = total - keep - fromBody;
+
+    send(*sink, std::string_view(contentBody).substr(0, fromBody), more.substr(0, fromMore), Deflater::CONTINUE);
+    contentBody.erase(0, fromBody);
+    contentBody.append(more.substr(fromMore));
+  }
+
+  const std::string* Response::tryGetParam(Common::Key name, option_t option) {
+    if(option == HEADER)
+      return findHeader(name);
     else if(option == SESSION)
-      return Session::getParam(name);
+      return Session::tryGetParam(name);
+    return NULL;
+  }
+
+  std::string Response::getParam(Common::Key name, option_t option) {
+    const std::string* value = tryGetParam(name, option);
+    if(not value)
+      throw Common::Exception("Parameter: " + std::string(name.getName()) + (option == HEADER ? " not found in headers" : " not found in session"),
+			      E_PARAM_NOT_FOUND, __LINE__, __FILE__);
+    return *value;
   }
 
   Response& Response::clearBody()  {
@@ -43,74 +184,111 @@ namespace CGI {
     completeBody.clear();
     if(binary)
       binaryData.reset();
+    return *this;
+  }
+
+  // Appends a Set-Cookie header for one cookie
+
+  static void appendCookie(std::string& out, std::string_view name, const cookie_t& c) {
+    char expire[HTTP_DATE_LENGTH];
+
+    out.append("Set-Cookie: ", 12).append(name).append(1, '=').append(c.value);
+    if(c.expire) // A cookie without Expires lives till the browser is closed
+      out.append("; Expires=", 10).append(expire, httpDate(c.expire, expire));
+    if(not c.domain.empty())
+      out.append("; Domain=", 9).append(c.domain);
+    if(not c.path.empty())
+      out.append("; Path=", 7).append(c.path);
+    if(c.secure)
+      out.append("; Secure", 8);
+    if(c.httponly)
+      out.append("; HttpOnly", 10);
+    out.append("\r\n", 2);
   }
 
   void Response::setupHeaders() {
-    cookie_t c;
-    c.value = getSessionId();
+    const CGI::Request &req = getRequest();
+    std::string_view cookieName = Common::Registry::getService<Common::Config>().getParam(Common::Keys::SESS_COOKIENAME);
+    const cookie_dict_t& cookies = getCookies();
+    cookie_t session;
 
-    /*
-      Cookie should have secure parameter if protocol is HTTPS
-      Check for environment variable HTTP_HTTPS or HTTPS with value on, ON or 1
-      and set secure property
-    */
+    if(isDirty() and not cookieName.empty() and not cookies.count(std::string(cookieName))) { // Only sessions holding data need the cookie
+      settleId();
+      session.value = getSessionId();
+      session.expire = getExpireTime();
 
-    std::string https;
-    Common::Registry &reg = Common::Registry::getInstance();
-    CGI::Request &req = reg.getItem<CGI::Request>("request");
+      /*
+	Cookie should have secure parameter if protocol is HTTPS
+	Check for environment variable HTTPS or HTTP_HTTPS with value on, ON or 1
+	and set secure property
+      */
 
-    try {
-      https = req.getParam("HTTPS", Request::ENV);
-    }
-    catch(Common::Exception e) {
-      if(e != E_PARAM_NOT_FOUND)
-	throw e;      
-      try {
-	https = req.getParam("HTTP_HTTPS", Request::ENV);
-      }
-      catch(Common::Exception e) {
-	if(e != E_PARAM_NOT_FOUND)
-	  throw e;
-      }
-    }
+      const char* https = req.getEnv(Environment::HTTPS);
+      if(not https)
+	https = req.getEnv(Environment::HTTP_HTTPS);
+      session.secure = https and (not std::strcmp(https, "on") or not std::strcmp(https, "ON") or not std::strcmp(https, "1"));
 
-    if(https == "on" or https == "1" or https == "ON")
-      c.secure = true;
-    else
-      c.secure = false;
+      session.path = "/"; // Session cookies don't make sense in subdiretories
 
-    c.path = "/"; // Session cookies don't make sense in subdiretories
+      // Cookie domain cannot be set for complete domain name, they must be valid across all subdomains
+      // Suppose example1.example.com is the servername/httphost, then cookie will be valid for .example1.example.com, which is the default anyways if it is not set.
 
-    try {
-      c.domain = req.getParam("HTTP_HOST", Request::ENV);
-    }
-    catch(Common::Exception e) {
-      if(e != E_PARAM_NOT_FOUND)
-	throw e;
-      c.domain = req.getParam("SERVER_NAME", Request::ENV);
+      const char* host = req.getEnv(Environment::HTTP_HOST);
+      if(not host)
+	host = req.getEnv(Environment::SERVER_NAME);
+      if(host)
+	session.domain.append(1, '.').append(host);
     }
 
-    // Cookie domain cannot be set for complete domain name, they must be valid across all subdomains
-
-    c.domain = "." + c.domain; // suppose example1.example.com is the servername/httphost, then cookie will be valid for .example1.example.com, which is the default anyways if it is not set.
-    
-    cookie_dict_t cookies = getCookies();
-    cookie_dict_t::iterator cookieIterator;
-    Dict_t::iterator dictIterator;
-    for(dictIterator = headers.begin(); dictIterator != headers.end(); dictIterator++)
-      headerString += dictIterator->first + ": " + dictIterator->second + "\r\n";
-    for(cookieIterator = cookies.begin(); cookieIterator != cookies.end(); cookieIterator++) {
-      cookie_t &ck = cookieIterator->second;
-      char expire[29]; // Wdy, dd-mm-yyyy hh:mm:ss GMT + NUL
-      std::setlocale(LC_TIME, "en_US");
-      std::strftime(expire, 29, "%a, %d-%m-%Y %H:%M:%S GMT", std::gmtime(&ck.expire));
-      headerString += "Set-Cookie: " + cookieIterator->first + "=" + ck.value + "; Expires=" + expire + "; ";
-      headerString += "Domain=" + ck.domain + "; Path=" + ck.path + "; \r\n";
-    }
-    headerString += "\r\n\r\n";
+    // Size the buffer once, a cookie takes its parts plus at most ~70 bytes of attribute names and the date
+
+    size_t size = 2;
+    for(int k = 0; k < HEADER_SLOTS; k++)
+      if(knownHeaderMask & (1U << k))
+	size += Common::knownKeys[Common::KNOWN_HEADERS + k].size() + knownHeaders[k].size() + 4;
+    for(Dict_t::const_iterator i = headers.begin(); i != headers.end(); i++)
+      size += i->first.size() + i->second.size() + 4;
+    for(cookie_dict_t::const_iterator i = cookies.begin(); i != cookies.end(); i++)
+      size += i->first.size() + i->second.value.size() + i->second.domain.size() + i->second.path.size() + 96;
+    if(not session.value.empty())
+      size += cookieName.size() + session.value.size() + session.domain.size() + 96;
+
+    headerString.clear();
+    headerString.reserve(size);
+    for(int k = 0; k < HEADER_SLOTS; k++)
+      if(knownHeaderMask & (1U << k))
+	headerString.append(Common::knownKeys[Common::KNOWN_HEADERS + k]).append(": ", 2).append(knownHeaders[k]).append("\r\n", 2);
+    for(Dict_t::const_iterator i = headers.begin(); i != headers.end(); i++)
+      headerString.append(i->first).append(": ", 2).append(i->second).append("\r\n", 2);
+    if(not session.value.empty())
+      appendCookie(headerString, cookieName, session);
+    for(cookie_dict_t::const_iterator i = cookies.begin(); i != cookies.end(); i++)
+      appendCookie(headerString, i->first, i->second);
+    headerString.append("\r\n", 2); // Blank line separating headers from the body
+  }
+
+  Response::Response() : knownHeaderMask(0), binary(false), binaryLength(0), request(NULL), sink(NULL), headersSent(false), highWatermark(0),
+			 lowWatermark(0), compressionLevel(0), compressionMin(0), encoding(Deflater::IDENTITY) {
+    setParam(Common::Keys::CONTENT_TYPE, "text/html; charset=utf-8", HEADER);
   }
-  Response::Response() {
-    setParam("Content-Type", "text/html", HEADER);
-    setParam("Content-Encoding", "utf-8", HEADER);
+
+  Response& Response::reset() {
+    headers.clear();
+    knownHeaderMask = 0;
+    headerString.clear();
+    clearBody();
+    binary = false;
+    binaryLength = 0;
+    sink = NULL;
+    headersSent = false;
+    encoding = Deflater::IDENTITY;
+    cached.reset();
+    resetCookies(true);
+    if(request)
+      share(*request); // The bound request has been reset before, it carries the session of the new request
+    else
+      renew();
+    setParam(Common::Keys::CONTENT_TYPE, "text/html; charset=utf-8", HEADER);
+    return *this;
   }
 }
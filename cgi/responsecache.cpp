@@ -0,0 +1,159 @@
+#include <cgi/cgi.hpp>
+#include <cstring>
+
+/*! \file responsecache.cpp
+  \brief Implementation of CGI::ResponseCache
+*/
+
+namespace CGI {
+
+  /*
+   * contentHash() follows wyhash: 16 bytes are folded into the state per round by a 64x64->128 bit multiplication
+   * whose halves are xor-ed. Much faster than a byte at a time hash (Common::hash) on bodies of many kilobytes.
+   */
+
+  static inline uint64_t mix(uint64_t a, uint64_t b) {
+    __uint128_t product = (__uint128_t) a * b;
+    return (uint64_t) product ^ (uint64_t) (product >> 64);
+  }
+
+  static inline uint64_t read64(const char* p) {
+    uint64_t v;
+    std::memcpy(&v, p, 8);
+    return v;
+  }
+
+  static inline uint64_t read32(const char* p) {
+    uint32_t v;
+    std::memcpy(&v, p, 4);
+    return v;
+  }
+
+  uint64_t ResponseCache::contentHash(std::string_view data, uint64_t seed) {
+    static const uint64_t p0 = 0xa0761d6478bd642fULL, p1 = 0xe7037ed1a0b428dbULL;
+    const char* p = data.data();
+    size_t length = data.size(), left = length;
+    uint64_t a = 0, b = 0;
+
+    seed ^= p0;
+    for(; left > 16; left -= 16, p += 16)
+      seed = mix(read64(p) ^ p1, read64(p + 8) ^ seed);
+    if(left >= 8) {
+      a = read64(p);
+      b = read64(p + left - 8);
+    }
+    else if(left >= 4) {
+      a = read32(p);
+      b = read32(p + left - 4);
+    }
+    else if(left) {
+      a = (uint64_t) (unsigned char) p[0] << 16 | (uint64_t) (unsigned char) p[left >> 1] << 8 | (unsigned char) p[left - 1];
+    }
+    return mix(p1 ^ length, mix(a ^ p1, b ^ seed));
+  }
+
+  ResponseCache::entry_ptr_t ResponseCache::find(const std::string& key) {
+    std::lock_guard<std::mutex> guard (lock);
+    std::unordered_map<std::string, lru_t::iterator>::iterator k = byKey.find(key);
+    if(k == byKey.end())
+      return entry_ptr_t();
+    lru_t::iterator slot = k->second;
+    lru.splice(lru.begin(), lru, slot);
+    return slot->entry;
+  }
+
+  void ResponseCache::unbind(const std::string& key) {
+    std::unordered_map<std::string, lru_t::iterator>::iterator k = byKey.find(key);
+    if(k == byKey.end())
+      return;
+    lru_t::iterator slot = k->second;
+    slot->keys.erase(std::find(slot->keys.begin(), slot->keys.end(), key));
+    slot->bytes -= key.size();
+    used -= key.size();
+    byKey.erase(k);
+  }
+
+  void ResponseCache::bind(const std::string& key, lru_t::iterator slot) {
+    std::unordered_map<std::string, lru_t::iterator>::iterator k = byKey.find(key);
+    if(k != byKey.end() and k->second == slot)
+      return;
+    unbind(key);
+    byKey[key] = slot;
+    slot->keys.push_back(key);
+    slot->bytes += key.size();
+    used += key.size();
+  }
+
+  // Content of an entry found by its hash, which says nothing for sure
+
+  static bool sameContent(const ResponseCache::entry_t& entry, std::string_view contentType, std::string_view body) {
+    return entry.contentType == contentType and entry.body.size() == body.size() and
+      std::memcmp(entry.body.data(), body.data(), body.size()) == 0;
+  }
+
+  void ResponseCache::evict() {
+    while(used > budget and not lru.empty()) {
+      lru_t::iterator last = std::prev(lru.end());
+      slot_t& victim = *last;
+      for(std::vector<std::string>::iterator k = victim.keys.begin(); k != victim.keys.end(); k++)
+	byKey.erase(*k);
+      std::unordered_map<uint64_t, lru_t::iterator>::iterator h = byHash.find(victim.entry->hash);
+      if(h != byHash.end() and h->second == last)
+	byHash.erase(h);
+      used -= victim.bytes;
+      lru.pop_back(); // Holders of the entry keep it alive
+    }
+  }
+
+  ResponseCache::entry_ptr_t ResponseCache::store(const std::string& key, std::string_view contentType, std::string_view body) {
+    uint64_t hash = contentHash(body, contentHash(contentType));
+
+    {
+      std::lock_guard<std::mutex> guard (lock);
+      std::unordered_map<uint64_t, lru_t::iterator>::iterator existing = byHash.find(hash);
+      if(existing != byHash.end() and sameContent(*existing->second->entry, contentType, body)) {
+	lru_t::iterator slot = existing->second;
+	lru.splice(lru.begin(), lru, slot);
+	bind(key, slot);
+	evict();
+	return slot->entry;
+      }
+    }
+
+    // Compression is the expensive part, other threads go on meanwhile
+
+    std::shared_ptr<entry_t> entry (new entry_t);
+    entry->hash = hash;
+    entry->contentType = contentType;
+    entry->body = body;
+    if(Deflater::compressible(contentType)) {
+      Deflater deflater;
+      StringSink sink (entry->gzip);
+      deflater.begin(Deflater::GZIP, level);
+      deflater.write(body, Deflater::FINISH, sink);
+      if(entry->gzip.size() >= body.size())
+	std::string().swap(entry->gzip); // Does not pay off
+      else
+	entry->gzip.shrink_to_fit();
+    }
+
+    size_t bytes = sizeof(entry_t) + entry->contentType.size() + entry->body.size() + entry->gzip.size() + key.size();
+    std::lock_guard<std::mutex> guard (lock);
+    std::unordered_map<uint64_t, lru_t::iterator>::iterator existing = byHash.find(hash);
+    bool colliding = existing != byHash.end() and not sameContent(*existing->second->entry, contentType, body);
+    if(bytes > budget or (existing != byHash.end() and not colliding)) // Too large, or stored by another thread meanwhile
+      return entry;
+    unbind(key);
+    slot_t slot;
+    slot.entry = entry;
+    slot.keys.push_back(key);
+    slot.bytes = bytes;
+    lru.push_front(slot);
+    if(not colliding) // Otherwise the slot is found by its keys only
+      byHash[hash] = lru.begin();
+    byKey[key] = lru.begin();
+    used += bytes;
+    evict();
+    return entry;
+  }
+}
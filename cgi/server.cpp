@@ -0,0 +1,146 @@
+#include <cgi/cgi.hpp>
+#include <fcgiapp.h>
+#include <thread>
+#include <cstdio>
+#include <cstdlib>
+
+/*! \file server.cpp
+  \brief Implementation of CGI::Server
+*/
+
+namespace CGI {
+
+  // Logs a request which failed and answers it with a 500, unless part of the page has been sent already
+
+  static void fail(FCGX_Request& fcgx, Response* current, const char* message) {
+    FCGX_PutS(message, fcgx.err);
+    FCGX_PutS("\n", fcgx.err);
+    if(not current or not current->isCommitted()) // Otherwise part of the page has been sent, it cannot be replaced
+      FCGX_PutS("Status: 500 Internal Server Error\r\nContent-Type: text/plain\r\n\r\nInternal Server Error\n", fcgx.out);
+    if(current)
+      current->setSink(NULL);
+  }
+
+  Server::Server(std::string configFile, handler_t _handler) : config(new Common::ConfigWatcher(configFile)), handler(_handler) {
+    const Common::Config& settings = config->get(); // Read at startup only, changing these takes a restart
+    std::string_view cacheSize = settings.getParam("response_cache_size");
+    cache.reset(new ResponseCache(cacheSize.empty() ? 16777216 : std::strtoul(cacheSize.data(), NULL, 10)));
+    std::string_view store = settings.getParam("session_store");
+    if(store == "file")
+      sessions.reset(new FileSessionStore(std::string(settings.getParam("session_path"))));
+    else if(store == "shm") {
+      std::string_view path = settings.getParam("session_path"), slots = settings.getParam("session_slots"), slotSize = settings.getParam("session_slot_size");
+      sessions.reset(new ShmSessionStore(path.empty() ? "/dev/shm/cxxcms-sessions" : std::string(path),
+					 slots.empty() ? 16384 : std::strtoul(slots.data(), NULL, 10),
+					 slotSize.empty() ? 2048 : std::strtoul(slotSize.data(), NULL, 10)));
+    }
+    else
+      sessions.reset(new MemorySessionStore);
+    std::string_view signingKey = settings.getParam("session_signing_key"), cookieLimit = settings.getParam("session_cookie_limit");
+    if(not signingKey.empty())
+      signer.reset(new SessionSigner(std::string(signingKey), cookieLimit.empty() ? 3072 : std::strtoul(cookieLimit.data(), NULL, 10)));
+
+    // Provided before any worker starts, the workers only read them
+
+    Common::Registry::provide(cache.get());
+    Common::Registry::provide(sessions.get());
+    Common::Registry::provide(signer.get());
+  }
+
+  Server::~Server() {
+    if(Common::Registry::findService<ResponseCache>() == cache.get())
+      Common::Registry::provide<ResponseCache>(NULL);
+    if(Common::Registry::findService<SessionStore>() == sessions.get())
+      Common::Registry::provide<SessionStore>(NULL);
+    if(signer and Common::Registry::findService<SessionSigner>() == signer.get())
+      Common::Registry::provide<SessionSigner>(NULL);
+  }
+
+  void Server::work() {
+    Common::Registry &reg = Common::Registry::getInstance(); // Registry of this thread, for handlers looking items up by name
+    reg.addItem(Common::Keys::RESPONSE_CACHE, cache.get());
+    reg.addItem(Common::Keys::SESSION_STORE, static_cast<SessionStore*>(sessions.get()));
+    Common::ConfigWatcher::Reader reader (*config);
+
+    FCGX_Request fcgx;
+    FCGX_InitRequest(&fcgx, 0, 0);
+    std::unique_ptr<Request> request;
+    std::unique_ptr<Response> response;
+
+    while(true) {
+      int accepted;
+      {
+	std::lock_guard<std::mutex> lock (acceptLock);
+	accepted = FCGX_Accept_r(&fcgx);
+      }
+      if(accepted < 0)
+	break;
+
+      // The configuration stays the same till the request is finished, a reload takes effect from the next one
+
+      Common::Config& settings = reader.enter();
+      reg.addItem(Common::Keys::CONFIG, &settings);
+
+      FCGXSink sink (fcgx.out);
+      Response* current = NULL; // Set once the response has been prepared for this request
+
+      try {
+	if(not request) {
+	  request.reset(new Request(fcgx.envp, fcgx.in));
+	  reg.addItem(Common::Keys::REQUEST, request.get());
+	  response.reset(new Response);
+	  response->setRequest(*request);
+	}
+	else {
+	  request->reset(fcgx.envp, fcgx.in);
+	  response->reset();
+	}
+
+	// Compression is on at level 1 for bodies of 1 KiB or more unless configured otherwise, 0 turns it off
+
+	std::string_view compressionLevel = settings.getParam(Common::Keys::RESPONSE_COMPRESSION_LEVEL);
+	std::string_view compressionMin = settings.getParam(Common::Keys::RESPONSE_COMPRESSION_MIN);
+	response->setStreaming(std::strtoul(settings.getParam(Common::Keys::RESPONSE_STREAM_HIGH).data(), NULL, 10),
+			       std::strtoul(settings.getParam(Common::Keys::RESPONSE_STREAM_LOW).data(), NULL, 10));
+	response->setCompression(compressionLevel.empty() ? 1 : std::atoi(compressionLevel.data()),
+				 compressionMin.empty() ? 1024 : std::strtoul(compressionMin.data(), NULL, 10));
+	current = response.get();
+	current->setSink(&sink);
+	handler(*request, *current);
+	current->commit(); // Before the response is sent, the next request of the client may follow right after it
+	current->flush(sink);
+	current->setSink(NULL);
+      }
+      catch(Common::Exception e) {
+	fail(fcgx, current, e.getCMessage());
+      }
+      catch(const std::exception& e) { // From the handler or the standard library, std::bad_alloc for instance
+	fail(fcgx, current, e.what());
+      }
+      catch(...) {
+	fail(fcgx, current, "Unknown exception thrown by the request handler");
+      }
+      FCGX_Finish_r(&fcgx);
+      reader.leave();
+    }
+    FCGX_Free(&fcgx, 0);
+  }
+
+  int Server::run(unsigned int threads) {
+    if(not threads)
+      threads = std::strtoul(config->get().getParam("server_threads").data(), NULL, 10);
+    if(not threads)
+      threads = 1;
+
+    if(FCGX_Init() != 0)
+      return 1;
+
+    std::vector<std::thread> workers;
+    for(unsigned int i = 1; i < threads; i++)
+      workers.emplace_back(&Server::work, this);
+    work(); // The calling thread is a worker too
+    for(std::thread& t : workers)
+      t.join();
+    return 0;
+  }
+}
@@ -1,39 +1,142 @@
 #include <cgi/cgi.hpp>
-#include <uuid/uuid.h>
 #include <cstdlib>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 /*! \file session.cpp
   \brief Implementation of CGI::Session
 */
 
 namespace CGI {
-  /* We have static members in the class, we need to initialize them, so that the methods in the class can reference them using FQN
-     This works only for static members (even for private members) */
-  std::string Session::id;
-  time_t Session::expire;
-  Dict_t Session::data;
-  bool Session::response; // See constructor definition in the above class
 
-  Session::Session() {
-    uuid_t uu;
-    char _id[16];
-    uuid_generate(uu);
-    uuid_unparse(uu, _id);
-    id = _id;
+  // Session lifetime from the configuration, in seconds
+
+  static time_t sessionLifetime() {
+    return (time_t) std::atol(Common::Registry::getService<Common::Config>().getParam(Common::Keys::SESSION_EXPIRE).data());
+  }
+
+  // Store and signer provided to the process, if any
+
+  static SessionStore* sessionStore() {
+    return Common::Registry::findService<SessionStore>();
+  }
+
+  static const SessionSigner* sessionSigner() {
+    return Common::Registry::findService<SessionSigner>();
+  }
+
+  Session::Session() : response(true) {
+    renew();
+  }
+
+  /*
+   * A session id is 128 random bits written as 32 lowercase hex digits, which survive cookies and
+   * file names unescaped. With SSE2 the nibbles of all 16 bytes are split and interleaved in two
+   * registers and mapped to digits by adding '0', plus 39 more where the nibble is above 9.
+   */
+
+  std::string Session::newId() {
+    unsigned char bytes[16];
+    std::string id (32, '\0');
+    Common::randomBytes(bytes, sizeof bytes);
 
-    Common::Registry &reg = Common::Registry::getInstance();
-    setExpireTime(std::time(NULL) + (time_t) std::atol(reg.getItem<Common::Config>("config").getParam("session_expire").c_str()));
-   }
+#if defined(__SSE2__)
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes)), mask = _mm_set1_epi8(0x0F);
+    __m128i high = _mm_and_si128(_mm_srli_epi16(v, 4), mask), low = _mm_and_si128(v, mask);
+    __m128i digits[2] = {_mm_unpacklo_epi8(high, low), _mm_unpackhi_epi8(high, low)};
+    for(__m128i& d : digits) {
+      __m128i letters = _mm_and_si128(_mm_cmpgt_epi8(d, _mm_set1_epi8(9)), _mm_set1_epi8('a' - '0' - 10));
+      d = _mm_add_epi8(_mm_add_epi8(d, _mm_set1_epi8('0')), letters);
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&id[0]), digits[0]);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&id[16]), digits[1]);
+#else
+    static const char hex[] = "0123456789abcdef";
+    for(size_t i = 0; i < sizeof bytes; i++) {
+      id[2 * i] = hex[bytes[i] >> 4];
+      id[2 * i + 1] = hex[bytes[i] & 15];
+    }
+#endif
+    return id;
+  }
+
+  void Session::renew() {
+    state = std::make_shared<state_t>(); // Instances which shared the previous state keep it
+    state->id = newId();
+    state->store = sessionStore();
+    state->signer = sessionSigner();
+    setExpireTime(std::time(NULL) + sessionLifetime());
+  }
+
+  void Session::resume(const std::string& id) {
+    state = std::make_shared<state_t>();
+    state->id = id;
+    state->store = sessionStore();
+    state->signer = sessionSigner();
+    state->pending = true;
+  }
+
+  void Session::fetch() const {
+    state->pending = false;
+    if(SessionSigner::isToken(state->id)) {
+      if(state->signer and state->signer->verify(state->id, state->data, state->expire))
+	return;
+    }
+    else if(state->store and state->store->load(state->id, state->data, state->expire)) {
+      state->stored = true;
+      return;
+    }
 
-  Session::Session(std::string _id) {
+    // Unknown or expired, the client does not get to choose the id of a new session
 
-    // To be implemented, first storage system has to be setup [DB]
+    state->id = newId();
+    state->data = Common::PersistentDict();
+    state->expire = std::time(NULL) + sessionLifetime();
+  }
+
+  void Session::commit() {
+    if(not state->dirty)
+      return;
+    state->expire = std::time(NULL) + sessionLifetime();
+    state->committed = true;
+
+    if(state->signer and not state->sent) {
+      std::string token;
+      if(state->signer->sign(state->data, state->expire, token)) {
+	if(state->stored) // Moved into the cookie, the stored copy is of no use anymore
+	  state->store->remove(state->id);
+	state->stored = false;
+	state->id = token;
+	return;
+      }
+    }
+    if(SessionSigner::isToken(state->id))
+      state->id = newId(); // Outgrew the cookie (or signing was turned off), stored from now on
+    if(state->store) {
+      state->store->save(state->id, state->data, state->expire);
+      state->stored = true;
+    }
+  }
+
+  void Session::settleId() {
+    if(not state->committed and not state->sent and SessionSigner::isToken(state->id))
+      state->id = newId(); // The token sent by the client would no longer match the data, #commit stores it under this id
+    state->sent = true;
+  }
 
+  Session::Session(std::string _id) : state(new state_t), response(false) {
+    state->id = _id;
+    if(not _id.empty()) {
+      state->store = sessionStore();
+      state->signer = sessionSigner();
+      state->pending = true;
+    }
   }
 
-  Dict_ptr_t Session::getData() const {
-    Dict_ptr_t ret (new Dict_t);
-    *ret = data;
-    return ret;
+  Common::PersistentDict Session::getData() const {
+    load();
+    return state->data;
   }
 }
@@ -0,0 +1,743 @@
+#include <cgi/cgi.hpp>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <atomic>
+#include <csignal>
+#include <sched.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+
+/*! \file sessionstore.cpp
+  \brief Implementation of CGI::MemorySessionStore, CGI::FileSessionStore, CGI::ShmSessionStore and CGI::SessionSigner
+*/
+
+namespace CGI {
+
+  /*
+   * Session data is serialized as an urlencoded query string, which Tokenizer reads back
+   */
+
+  static void encodeSession(const Common::PersistentDict& data, std::string& out) {
+    bool first = true;
+    for(Common::PersistentDict::const_iterator i = data.begin(); i != data.end(); ++i, first = false) {
+      if(not first)
+	out += '&';
+      urlencode(i->first, out);
+      out += '=';
+      urlencode(i->second, out);
+    }
+  }
+
+  static void decodeSession(char* buffer, size_t length, Common::PersistentDict& data) {
+    Tokenizer tokens (buffer, length);
+    std::string_view key, value;
+    data = Common::PersistentDict();
+    while(tokens.next(key, value))
+      data = data.set(key, value);
+  }
+
+  /*
+   * Implementation of MemorySessionStore
+   */
+
+  MemorySessionStore::MemorySessionStore(size_t count) {
+    size_t n = 1;
+    while(n < count)
+      n <<= 1;
+    shards.reset(new shard_t[n]);
+    mask = n - 1;
+  }
+
+  bool MemorySessionStore::load(const std::string& id, Common::PersistentDict& data, time_t& expire) {
+    shard_t& shard = shardOf(id);
+    std::lock_guard<std::mutex> guard (shard.lock);
+    std::unordered_map<std::string, record_t>::iterator i = shard.sessions.find(id);
+    if(i == shard.sessions.end())
+      return false;
+    if(i->second.expire <= std::time(NULL)) {
+      shard.sessions.erase(i);
+      return false;
+    }
+    data = i->second.data;
+    expire = i->second.expire;
+    return true;
+  }
+
+  void MemorySessionStore::save(const std::string& id, const Common::PersistentDict& data, time_t expire) {
+    shard_t& shard = shardOf(id);
+    std::lock_guard<std::mutex> guard (shard.lock);
+    record_t& record = shard.sessions[id];
+    record.data = data;
+    record.expire = expire;
+
+    if(++shard.writes < SWEEP_INTERVAL)
+      return;
+    shard.writes = 0;
+    time_t now = std::time(NULL);
+    for(std::unordered_map<std::string, record_t>::iterator i = shard.sessions.begin(); i != shard.sessions.end(); )
+      if(i->second.expire <= now)
+	i = shard.sessions.erase(i);
+      else
+	i++;
+  }
+
+  void MemorySessionStore::remove(const std::string& id) {
+    shard_t& shard = shardOf(id);
+    std::lock_guard<std::mutex> guard (shard.lock);
+    shard.sessions.erase(id);
+  }
+
+  size_t MemorySessionStore::size() const {
+    size_t n = 0;
+    for(size_t i = 0; i <= mask; i++) {
+      std::lock_guard<std::mutex> guard (shards[i].lock);
+      n += shards[i].sessions.size();
+    }
+    return n;
+  }
+
+  /*
+   * Implementation of FileSessionStore
+   */
+
+  // The id comes from a cookie, anything which could leave the directory is refused
+
+  static bool validId(const std::string& id) {
+    if(id.empty() or id.size() > 128)
+      return false;
+    for(size_t i = 0; i < id.size(); i++)
+      if(not std::isalnum((unsigned char) id[i]) and id[i] != '-')
+	return false;
+    return true;
+  }
+
+  std::string FileSessionStore::pathOf(const std::string& id) const {
+    if(not validId(id))
+      throw Common::Exception("Invalid session id", E_SESSION_STORE, __LINE__, __FILE__);
+    return directory + "/sess_" + id;
+  }
+
+  bool FileSessionStore::load(const std::string& id, Common::PersistentDict& data, time_t& expire) {
+    if(not validId(id))
+      return false; // A forged id is not an error of the storage, the client gets a new session
+    std::string path = pathOf(id);
+
+    FILE* file = std::fopen(path.c_str(), "rb");
+    if(not file) {
+      if(errno == ENOENT)
+	return false;
+      throw Common::Exception("Session file " + path + " could not be opened", E_SESSION_STORE, __LINE__, __FILE__);
+    }
+    std::string content;
+    char buffer[4096];
+    size_t n;
+    while((n = std::fread(buffer, 1, sizeof buffer, file)) > 0)
+      content.append(buffer, n);
+    std::fclose(file);
+
+    size_t newline = content.find('\n');
+    if(newline == std::string::npos)
+      return false; // Not written by us
+    time_t stored = (time_t) std::strtoll(content.c_str(), NULL, 10);
+    if(stored <= std::time(NULL)) {
+      unlink(path.c_str());
+      return false;
+    }
+
+    decodeSession(&content[newline + 1], content.size() - newline - 1, data);
+    expire = stored;
+    return true;
+  }
+
+  void FileSessionStore::save(const std::string& id, const Common::PersistentDict& data, time_t expire) {
+    std::string path = pathOf(id);
+    std::string content = std::to_string((long long) expire);
+    content += '\n';
+    encodeSession(data, content);
+
+    std::string temporary = path + ".XXXXXX";
+    int fd = mkstemp(&temporary[0]);
+    if(fd < 0)
+      throw Common::Exception("Session file " + path + " could not be created", E_SESSION_STORE, __LINE__, __FILE__);
+    const char* p = content.data();
+    size_t left = content.size();
+    while(left) {
+      ssize_t written = write(fd, p, left);
+      if(written < 0 and errno == EINTR)
+	continue;
+      if(written <= 0) {
+	close(fd);
+	unlink(temporary.c_str());
+	throw Common::Exception("Session file " + path + " could not be written", E_SESSION_STORE, __LINE__, __FILE__);
+      }
+      p += written;
+      left -= written;
+    }
+    close(fd);
+    if(std::rename(temporary.c_str(), path.c_str()) != 0) {
+      unlink(temporary.c_str());
+      throw Common::Exception("Session file " + path + " could not be written", E_SESSION_STORE, __LINE__, __FILE__);
+    }
+    sweep();
+  }
+
+  void FileSessionStore::sweep() {
+    std::unique_lock<std::mutex> guard (sweepLock, std::try_to_lock);
+    if(not guard.owns_lock())
+      return; // Another thread is sweeping, the next write continues
+    if(not cursor and not (cursor = opendir(directory.c_str())))
+      return;
+
+    time_t now = std::time(NULL);
+    for(unsigned int checked = 0; checked < SWEEP_STEP; ) {
+      struct dirent* entry = readdir(cursor);
+      if(not entry) { // The next write starts over
+	rewinddir(cursor);
+	return;
+      }
+      if(std::strncmp(entry->d_name, "sess_", 5) != 0)
+	continue;
+      checked++;
+
+      std::string path = directory + "/" + entry->d_name;
+      struct stat info;
+      if(std::strchr(entry->d_name, '.')) { // Written to by save, or abandoned
+	if(stat(path.c_str(), &info) == 0 and info.st_mtime + STALE_TEMPORARY < now)
+	  unlink(path.c_str());
+	continue;
+      }
+
+      int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+      if(fd < 0)
+	continue;
+      char head[32];
+      ssize_t n = read(fd, head, sizeof head - 1);
+      head[n > 0 ? n : 0] = '\0';
+
+      /*
+       * save replaces a file by renaming a new one over it, hence the content read through fd stays that of the file
+       * opened. It is removed only if the path still names that file, checked right before unlink while fd is open.
+       * A save renaming a new version into place between the check and unlink is not excluded, the session is then
+       * lost and the client starts over with a new one. This is accepted: the file has expired, hence only a request
+       * which loaded the session before it expired and saves it within that window can be affected.
+       */
+
+      struct stat current;
+      if(std::strchr(head, '\n') and (time_t) std::strtoll(head, NULL, 10) <= now and fstat(fd, &info) == 0 and
+	 stat(path.c_str(), &current) == 0 and current.st_ino == info.st_ino and current.st_dev == info.st_dev)
+	unlink(path.c_str());
+      close(fd);
+    }
+  }
+
+  FileSessionStore::~FileSessionStore() {
+    if(cursor)
+      closedir(cursor);
+  }
+
+  void FileSessionStore::remove(const std::string& id) {
+    if(validId(id))
+      unlink(pathOf(id).c_str());
+  }
+}
+
+namespace CGI {
+
+  /*
+   * Implementation of ShmSessionStore
+   *
+   * Layout of the file: a page holding header_t, followed by the slots. A slot is a slot_t followed by the payload
+   * (the serialized data). All of it is shared by the processes mapping the file, hence only lock-free atomics are used
+   * for synchronization and nothing in it may point into the address space of a process.
+   */
+
+  namespace {
+    const uint64_t SHM_MAGIC = 0x3153534553585843ULL; // "CXXSESS1"
+    const size_t ID_MAX = 96; // Longest id which can be stored
+    const unsigned int STALE_SPINS = 1 << 16; // Spins after which the holder of a lock is checked for being alive
+
+    struct header_t {
+      std::atomic<uint64_t> magic; //!< SHM_MAGIC once initialized
+      uint32_t slots; //!< Number of slots
+      uint32_t slotSize; //!< Size of a slot
+      std::atomic<uint32_t> cursor; //!< Next slot to be checked for expiry
+      std::atomic<int32_t> stripes[ShmSessionStore::STRIPES]; //!< Writer locks, pid of the holder or 0
+    };
+
+    enum slot_state_t {
+      EMPTY, //!< Never used, ends a probe sequence
+      LIVE, //!< Holds a session
+      DELETED, //!< Held a session, can be reused but does not end a probe sequence
+    };
+
+    struct slot_t {
+      std::atomic<uint32_t> seq; //!< Sequence lock, odd while the slot is being written
+      std::atomic<int32_t> writer; //!< Pid of the process writing the slot
+      uint32_t state; //!< slot_state_t
+      uint32_t idLength; //!< Length of id
+      uint32_t payloadLength; //!< Length of the payload
+      int64_t expire; //!< Expiry time of the session
+      uint64_t hash; //!< Hash of id
+      char id[ID_MAX]; //!< %Session id
+    };
+
+    static_assert(sizeof(header_t) <= 4096, "Header of the session file must fit in a page");
+
+    // Snapshot of the part of a slot which identifies it
+
+    struct view_t {
+      uint32_t state;
+      int64_t expire;
+      bool match; // Holds the id which was looked for
+    };
+
+    inline void pause() {
+#if defined(__x86_64__) || defined(__i386__)
+      __builtin_ia32_pause();
+#endif
+    }
+
+    inline bool alive(int32_t pid) {
+      return pid <= 0 or kill(pid, 0) == 0 or errno != ESRCH;
+    }
+
+    void lockStripe(std::atomic<int32_t>& lock) {
+      int32_t self = getpid();
+      for(unsigned int spins = 1; ; spins++) {
+	int32_t holder = 0;
+	if(lock.compare_exchange_weak(holder, self, std::memory_order_acquire))
+	  return;
+	if(spins % STALE_SPINS == 0) {
+	  if(holder and not alive(holder))
+	    lock.compare_exchange_strong(holder, 0); // Died holding it
+	  else
+	    sched_yield();
+	}
+	else
+	  pause();
+      }
+    }
+
+    inline void unlockStripe(std::atomic<int32_t>& lock) {
+      lock.store(0, std::memory_order_release);
+    }
+
+    // Takes the sequence lock of a slot for writing. If the writer holding it has died, its half written slot is deleted.
+
+    void lockSlot(slot_t* slot) {
+      int32_t self = getpid();
+      for(unsigned int spins = 1; ; spins++) {
+	uint32_t seq = slot->seq.load(std::memory_order_relaxed);
+	if(not (seq & 1) and slot->seq.compare_exchange_weak(seq, seq + 1, std::memory_order_acquire)) {
+	  slot->writer.store(self, std::memory_order_relaxed);
+	  std::atomic_thread_fence(std::memory_order_release); // Readers must see seq odd before any change of the slot
+	  return;
+	}
+	if(spins % STALE_SPINS == 0) {
+	  int32_t writer = slot->writer.load(std::memory_order_relaxed);
+	  if((seq & 1) and not alive(writer) and slot->writer.compare_exchange_strong(writer, self)) {
+	    std::atomic_thread_fence(std::memory_order_release);
+	    slot->state = DELETED;
+	    return;
+	  }
+	  sched_yield();
+	}
+	else
+	  pause();
+      }
+    }
+
+    inline void unlockSlot(slot_t* slot) {
+      slot->seq.fetch_add(1, std::memory_order_release);
+    }
+
+    // Tells if a slot holds id, only reliable while the slot is locked
+
+    inline bool holds(const slot_t* slot, uint64_t hash, std::string_view id) {
+      return slot->state == LIVE and slot->hash == hash and slot->idLength == id.size() and std::memcmp(slot->id, id.data(), id.size()) == 0;
+    }
+
+    /*
+     * Reads the identifying part of a slot (and the payload into payload, if not NULL and the slot holds id) without
+     * locking, retrying while a writer is active. Returns false if the slot stays locked by a writer which has died.
+     */
+
+    bool readSlot(const slot_t* slot, uint64_t hash, std::string_view id, size_t capacity, view_t& view, std::string* payload) {
+      for(unsigned int spins = 1; ; spins++) {
+	uint32_t seq = slot->seq.load(std::memory_order_acquire);
+	if(seq & 1) {
+	  if(spins % STALE_SPINS == 0 and not alive(slot->writer.load(std::memory_order_relaxed)))
+	    return false;
+	  pause();
+	  continue;
+	}
+	view.state = slot->state;
+	view.expire = slot->expire;
+	uint32_t idLength = slot->idLength;
+	view.match = view.state == LIVE and slot->hash == hash and idLength == id.size() and
+	  std::memcmp(slot->id, id.data(), std::min<size_t>(id.size(), ID_MAX)) == 0;
+	if(view.match and payload) {
+	  size_t length = std::min<size_t>(slot->payloadLength, capacity);
+	  payload->assign(reinterpret_cast<const char*>(slot + 1), length);
+	}
+	std::atomic_thread_fence(std::memory_order_acquire);
+	if(slot->seq.load(std::memory_order_relaxed) == seq)
+	  return true;
+      }
+    }
+  }
+
+  ShmSessionStore::ShmSessionStore(std::string path, uint32_t _slots, uint32_t _slotSize) : fd(-1), base(NULL), length(0) {
+    slots = 1;
+    while(slots < _slots)
+      slots <<= 1;
+    slotSize = std::max<uint32_t>(_slotSize, sizeof(slot_t) + 64);
+    slotSize = (slotSize + 63) & ~63u; // Slots do not share cache lines
+    length = 4096 + (size_t) slots * slotSize;
+
+    if((fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600)) < 0)
+      throw Common::Exception("Session file " + path + " could not be opened", E_SESSION_STORE, __LINE__, __FILE__);
+
+    /*
+     * The processes starting at the same time take turns, the first one initializes the file. A file in use is never
+     * resized or cleared: other processes have it mapped, they would lose all sessions or fault past its new end.
+     */
+
+    flock(fd, LOCK_EX);
+    struct stat info;
+    if(fstat(fd, &info) != 0 or (info.st_size and (size_t) info.st_size != length)) {
+      flock(fd, LOCK_UN);
+      close(fd);
+      throw Common::Exception("Session file " + path + " has another size, session_slots or session_slot_size differ from the processes using it",
+			      E_SESSION_STORE, __LINE__, __FILE__);
+    }
+    if(not info.st_size and ftruncate(fd, length) != 0) {
+      flock(fd, LOCK_UN);
+      close(fd);
+      throw Common::Exception("Session file " + path + " could not be sized", E_SESSION_STORE, __LINE__, __FILE__);
+    }
+    void* mapping = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if(mapping == MAP_FAILED) {
+      flock(fd, LOCK_UN);
+      close(fd);
+      throw Common::Exception("Session file " + path + " could not be mapped", E_SESSION_STORE, __LINE__, __FILE__);
+    }
+    base = static_cast<char*>(mapping);
+
+    header_t* header = reinterpret_cast<header_t*>(base);
+    uint64_t magic = header->magic.load();
+    if(not magic) { // New, or sized by a process which died before initializing it. Zero is a valid empty state for every field
+      header->slots = slots;
+      header->slotSize = slotSize;
+      header->magic.store(SHM_MAGIC);
+    }
+    else if(magic != SHM_MAGIC or header->slots != slots or header->slotSize != slotSize) {
+      munmap(base, length);
+      flock(fd, LOCK_UN);
+      close(fd);
+      throw Common::Exception("Session file " + path + " has another layout, session_slots or session_slot_size differ from the processes using it",
+			      E_SESSION_STORE, __LINE__, __FILE__);
+    }
+    flock(fd, LOCK_UN);
+  }
+
+  ShmSessionStore::~ShmSessionStore() {
+    munmap(base, length);
+    close(fd); // The file stays, the sessions are kept for the next start
+  }
+
+  bool ShmSessionStore::load(const std::string& id, Common::PersistentDict& data, time_t& expire) {
+    uint64_t hash = Common::hash(id);
+    size_t capacity = slotSize - sizeof(slot_t);
+    std::string payload;
+    view_t view;
+
+    for(uint32_t i = 0; i < MAX_PROBE; i++) {
+      const slot_t* slot = reinterpret_cast<const slot_t*>(slotAt((hash + i) & (slots - 1)));
+      if(not readSlot(slot, hash, id, capacity, view, &payload))
+	continue;
+      if(view.state == EMPTY)
+	return false;
+      if(not view.match)
+	continue;
+      if(view.expire <= std::time(NULL))
+	return false;
+      decodeSession(&payload[0], payload.size(), data);
+      expire = view.expire;
+      return true;
+    }
+    return false;
+  }
+
+  void ShmSessionStore::save(const std::string& id, const Common::PersistentDict& data, time_t expire) {
+    std::string payload;
+    encodeSession(data, payload);
+    if(id.size() > ID_MAX or payload.size() > slotSize - sizeof(slot_t)) { // Dropped, rather than failing every request of the client
+      std::fprintf(stderr, "Session %s of %zu bytes does not fit into a shared memory slot, it is dropped\n", id.c_str(), payload.size());
+      remove(id); // A previous, smaller version would come back otherwise
+      return;
+    }
+
+    header_t* header = reinterpret_cast<header_t*>(base);
+    uint64_t hash = Common::hash(id);
+    size_t capacity = slotSize - sizeof(slot_t);
+    time_t now = std::time(NULL);
+    std::atomic<int32_t>& stripe = header->stripes[hash & (STRIPES - 1)];
+
+    // Writers of the same id share the stripe, hence an id cannot be inserted twice
+
+    lockStripe(stripe);
+    slot_t* target = NULL;
+    while(not target) {
+      slot_t *found = NULL, *free = NULL, *oldest = NULL;
+      time_t oldestExpire = 0;
+      view_t view;
+      for(uint32_t i = 0; i < MAX_PROBE; i++) {
+	slot_t* slot = reinterpret_cast<slot_t*>(slotAt((hash + i) & (slots - 1)));
+	if(not readSlot(slot, hash, id, capacity, view, NULL))
+	  continue;
+	if(view.match) {
+	  found = slot;
+	  break;
+	}
+	if(not free and (view.state != LIVE or view.expire <= now))
+	  free = slot;
+	if(not oldest or view.expire < oldestExpire) {
+	  oldest = slot;
+	  oldestExpire = view.expire;
+	}
+	if(view.state == EMPTY)
+	  break;
+      }
+
+      /*
+       * Writers of other stripes may take a free (or expired) slot between the scan and the lock,
+       * hence the choice is checked again under the lock of the slot and the scan repeated if it no longer holds.
+       * With all the slots in reach live, the session expiring first is evicted.
+       */
+
+      slot_t* candidate = found ? found : free ? free : oldest;
+      lockSlot(candidate);
+      if(found ? holds(candidate, hash, id) : (candidate->state != LIVE or candidate->expire <= (free ? now : oldestExpire)))
+	target = candidate;
+      else
+	unlockSlot(candidate);
+    }
+
+    target->state = LIVE;
+    target->hash = hash;
+    target->expire = expire;
+    target->idLength = id.size();
+    std::memcpy(target->id, id.data(), id.size());
+    target->payloadLength = payload.size();
+    std::memcpy(reinterpret_cast<char*>(target + 1), payload.data(), payload.size());
+    unlockSlot(target);
+    unlockStripe(stripe);
+
+    // Incremental sweep, a few slots per write
+
+    for(unsigned int n = 0; n < SWEEP_STEP; n++) {
+      slot_t* slot = reinterpret_cast<slot_t*>(slotAt(header->cursor.fetch_add(1, std::memory_order_relaxed) & (slots - 1)));
+      view_t view;
+      if(not readSlot(slot, 0, std::string_view(), capacity, view, NULL) or view.state != LIVE or view.expire > now)
+	continue;
+      lockSlot(slot);
+      if(slot->state == LIVE and slot->expire <= now)
+	slot->state = DELETED;
+      unlockSlot(slot);
+    }
+  }
+
+  void ShmSessionStore::remove(const std::string& id) {
+    header_t* header = reinterpret_cast<header_t*>(base);
+    uint64_t hash = Common::hash(id);
+    size_t capacity = slotSize - sizeof(slot_t);
+    std::atomic<int32_t>& stripe = header->stripes[hash & (STRIPES - 1)];
+    view_t view;
+
+    lockStripe(stripe);
+    for(uint32_t i = 0; i < MAX_PROBE; i++) {
+      slot_t* slot = reinterpret_cast<slot_t*>(slotAt((hash + i) & (slots - 1)));
+      if(not readSlot(slot, hash, id, capacity, view, NULL))
+	continue;
+      if(view.state == EMPTY)
+	break;
+      if(view.match) {
+	lockSlot(slot);
+	if(holds(slot, hash, id)) // An expired session may have been replaced meanwhile
+	  slot->state = DELETED;
+	unlockSlot(slot);
+	break;
+      }
+    }
+    unlockStripe(stripe);
+  }
+
+  /*
+   * Implementation of SessionSigner
+   *
+   * The payload is the expiry time in decimal, a newline and the data as encodeSession() writes it, as in the files
+   * of FileSessionStore. The MAC covers the token up to the second dot, "s." included.
+   */
+
+  static const char base64url[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+  static void encodeBase64url(const unsigned char* data, size_t length, std::string& out) {
+    size_t i = 0;
+    for(; i + 3 <= length; i += 3) {
+      uint32_t v = data[i] << 16 | data[i + 1] << 8 | data[i + 2];
+      char group[4] = {base64url[v >> 18], base64url[v >> 12 & 63], base64url[v >> 6 & 63], base64url[v & 63]};
+      out.append(group, 4);
+    }
+    if(length - i == 1) {
+      uint32_t v = data[i] << 16;
+      char group[2] = {base64url[v >> 18], base64url[v >> 12 & 63]};
+      out.append(group, 2);
+    }
+    else if(length - i == 2) {
+      uint32_t v = data[i] << 16 | data[i + 1] << 8;
+      char group[3] = {base64url[v >> 18], base64url[v >> 12 & 63], base64url[v >> 6 & 63]};
+      out.append(group, 3);
+    }
+  }
+
+  static constexpr std::array<signed char, 256> makeBase64urlTable() {
+    std::array<signed char, 256> t {};
+    for(int c = 0; c < 256; c++)
+      t[c] = -1;
+    for(int i = 0; i < 64; i++)
+      t[(unsigned char) base64url[i]] = i;
+    return t;
+  }
+
+  static constexpr std::array<signed char, 256> base64urlValues = makeBase64urlTable();
+
+  // Decodes unpadded base64url, false if data holds anything else
+
+  static bool decodeBase64url(std::string_view data, std::string& out) {
+    if(data.size() % 4 == 1)
+      return false;
+    out.reserve(out.size() + data.size() / 4 * 3 + 2);
+    uint32_t v = 0;
+    int bits = 0;
+    for(char c : data) {
+      signed char d = base64urlValues[(unsigned char) c];
+      if(d < 0)
+	return false;
+      v = v << 6 | d;
+      bits += 6;
+      if(bits >= 8) {
+	bits -= 8;
+	out += (char) (v >> bits);
+      }
+    }
+    return not (v & ((1u << bits) - 1)); // Leftover bits are zero, so that each value has one encoding
+  }
+
+  /*
+   * HMAC (RFC 2104) is H(key ^ opad, H(key ^ ipad, data)). The states after the first block of each hash depend on the
+   * key only, they are computed once and copied for every MAC.
+   */
+
+  SessionSigner::SessionSigner(std::string _key, size_t _limit) : innerPad(NULL), outerPad(NULL), limit(_limit) {
+    static const size_t BLOCK = 64; // SHA-256 block size
+    if(_key.size() < 32)
+      throw Common::Exception("The session signing key must be at least 32 bytes long", E_SESSION_STORE, __LINE__, __FILE__);
+
+    unsigned char key[BLOCK] = {0}, pad[BLOCK];
+    unsigned int length = 0;
+    if(_key.size() > BLOCK) // Longer keys are hashed first
+      EVP_Digest(_key.data(), _key.size(), key, &length, EVP_sha256(), NULL);
+    else
+      std::memcpy(key, _key.data(), _key.size());
+
+    innerPad = EVP_MD_CTX_new();
+    outerPad = EVP_MD_CTX_new();
+    for(size_t i = 0; i < BLOCK; i++)
+      pad[i] = key[i] ^ 0x36;
+    bool ok = innerPad and EVP_DigestInit_ex(innerPad, EVP_sha256(), NULL) and EVP_DigestUpdate(innerPad, pad, BLOCK);
+    for(size_t i = 0; i < BLOCK; i++)
+      pad[i] = key[i] ^ 0x5c;
+    ok = ok and outerPad and EVP_DigestInit_ex(outerPad, EVP_sha256(), NULL) and EVP_DigestUpdate(outerPad, pad, BLOCK);
+    OPENSSL_cleanse(key, BLOCK);
+    OPENSSL_cleanse(pad, BLOCK);
+    if(not ok) {
+      EVP_MD_CTX_free(innerPad);
+      EVP_MD_CTX_free(outerPad);
+      throw Common::Exception("SHA-256 is not available from OpenSSL", E_SESSION_STORE, __LINE__, __FILE__);
+    }
+  }
+
+  SessionSigner::~SessionSigner() {
+    EVP_MD_CTX_free(innerPad);
+    EVP_MD_CTX_free(outerPad);
+  }
+
+  void SessionSigner::mac(const char* data, size_t length, unsigned char* out) const {
+    static thread_local std::unique_ptr<EVP_MD_CTX, void (*)(EVP_MD_CTX*)> context (EVP_MD_CTX_new(), EVP_MD_CTX_free);
+    unsigned char inner[32];
+    unsigned int size;
+    EVP_MD_CTX_copy_ex(context.get(), innerPad);
+    EVP_DigestUpdate(context.get(), data, length);
+    EVP_DigestFinal_ex(context.get(), inner, &size);
+    EVP_MD_CTX_copy_ex(context.get(), outerPad);
+    EVP_DigestUpdate(context.get(), inner, sizeof inner);
+    EVP_DigestFinal_ex(context.get(), out, &size);
+  }
+
+  bool SessionSigner::sign(const Common::PersistentDict& data, time_t expire, std::string& token) const {
+    std::string payload = std::to_string((long long) expire);
+    payload += '\n';
+    encodeSession(data, payload);
+
+    // s. + payload + . + 43 characters of MAC
+
+    if(2 + (payload.size() * 4 + 2) / 3 + 1 + 43 > limit)
+      return false;
+
+    unsigned char digest[32];
+    token.assign("s.", 2);
+    encodeBase64url(reinterpret_cast<const unsigned char*>(payload.data()), payload.size(), token);
+    mac(token.data(), token.size(), digest);
+    token += '.';
+    encodeBase64url(digest, sizeof digest, token);
+    return true;
+  }
+
+  bool SessionSigner::verify(const std::string& token, Common::PersistentDict& data, time_t& expire) const {
+    if(token.size() > limit or not isToken(token)) // Nothing is computed for oversized tokens
+      return false;
+    size_t dot = token.rfind('.');
+    if(dot < 2)
+      return false;
+
+    unsigned char expected[32];
+    std::string sent;
+    mac(token.data(), dot, expected);
+    if(not decodeBase64url(std::string_view(token).substr(dot + 1), sent) or sent.size() != sizeof expected or
+       CRYPTO_memcmp(sent.data(), expected, sizeof expected) != 0)
+      return false;
+
+    // Authentic from here on, the payload was made by sign()
+
+    std::string payload;
+    if(not decodeBase64url(std::string_view(token).substr(2, dot - 2), payload))
+      return false;
+    size_t newline = payload.find('\n');
+    if(newline == std::string::npos)
+      return false;
+    time_t when = (time_t) std::atoll(payload.c_str());
+    if(when <= std::time(NULL))
+      return false;
+    decodeSession(&payload[newline + 1], payload.size() - newline - 1, data);
+    expire = when;
+    return true;
+  }
+}
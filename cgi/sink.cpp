@@ -0,0 +1,61 @@
+#include <cgi/cgi.hpp>
+#include <fcgiapp.h>
+#include <climits>
+#include <algorithm>
+#include <cerrno>
+#include <unistd.h>
+
+/*! \file sink.cpp
+  \brief Implementation of CGI::FdSink, CGI::StringSink and CGI::FCGXSink
+*/
+
+namespace CGI {
+
+  void FdSink::write(const struct iovec* iov, int count) {
+    struct iovec pending[IOV_MAX];
+
+    // writev takes at most IOV_MAX buffers, more are written in batches of that many
+
+    for(int done = 0, batch; done < count; done += batch) {
+      batch = std::min(count - done, IOV_MAX);
+      std::copy(iov + done, iov + done + batch, pending);
+
+      // writev may write less than asked for (pipes, sockets), continue from where it stopped
+
+      struct iovec *current = pending, *end = pending + batch;
+      while(current != end) {
+	ssize_t written = writev(fd, current, end - current);
+	if(written < 0) {
+	  if(errno == EINTR)
+	    continue;
+	  throw Common::Exception("Response could not be written", E_OUTPUT_FAILED, __LINE__, __FILE__);
+	}
+	while(current != end and (size_t) written >= current->iov_len)
+	  written -= (current++)->iov_len;
+	if(current != end) {
+	  current->iov_base = static_cast<char*>(current->iov_base) + written;
+	  current->iov_len -= written;
+	}
+      }
+    }
+  }
+
+  void StringSink::write(const struct iovec* iov, int count) {
+    for(int i = 0; i < count; i++)
+      out.append(static_cast<const char*>(iov[i].iov_base), iov[i].iov_len);
+  }
+
+  void FCGXSink::write(const struct iovec* iov, int count) {
+    for(int i = 0; i < count; i++) {
+      const char* data = static_cast<const char*>(iov[i].iov_base);
+      size_t length = iov[i].iov_len;
+      while(length) {
+	int chunk = length > INT_MAX ? INT_MAX : length; // FCGX_PutStr takes an int
+	if(FCGX_PutStr(data, chunk, out) != chunk)
+	  throw Common::Exception("Response could not be written", E_OUTPUT_FAILED, __LINE__, __FILE__);
+	data += chunk;
+	length -= chunk;
+      }
+    }
+  }
+}
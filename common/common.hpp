@@ -4,8 +4,17 @@
 #include <global.hpp>
 #include <map>
 #include <memory>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <optional>
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <cctype>
+#include <cstdint>
+#include <string_view>
+#include <vector>
 
 /*! \file common.hpp
   \brief %Common utilities
@@ -14,6 +23,8 @@
   and small class methods are implemented inline
 */
 
+struct stat; // sys/stat.h, only references are used in this header
+
 /*! \namespace Common
   \brief %Common functions/classes
 
@@ -28,6 +39,8 @@ namespace Common {
     E_CONFIG_LOAD, //!< Error while loading configuration file
     E_CONFIG_PARAM_NOT_FOUND, //!< Configuration parameter not found \sa Config::operator[]
     E_REGISTRY_ITEM_NOT_FOUND, //!< Registry item not found \sa Registry::getItem
+    E_RANDOM, //!< No entropy available to key the random generator \sa randomBytes
+    E_REGISTRY_TYPE_MISMATCH, //!< Registry item was added with another type \sa Registry::getItem
   };
 
 
@@ -52,6 +65,7 @@ namespace Common {
     int code; //!< Error code of the exception
     unsigned int line; //!< Line number in the file where the exception was thrown
     std::string file; //!< File name in which exception was thrown
+    mutable std::string cmessage; //!< Storage for the string returned by #getCMessage
     
   public:
 
@@ -105,23 +119,506 @@ namespace Common {
     const char* getCMessage() const;
   };
 
+  /*! \brief Hash function used for dictionary keys
+
+    64-bit FNV-1a. It is constexpr so that hashes of literals can be computed at compile time.
+
+    \param[in] key Key to be hashed
+    \return 64-bit hash of key
+  */
+
+  constexpr uint64_t hash(std::string_view key) {
+    uint64_t h = 14695981039346656037ULL;
+    for(char c : key)
+      h = (h ^ (unsigned char) c) * 1099511628211ULL;
+    return h;
+  }
+
+  /*! \brief Names known in advance, which Key resolves to slots
+
+    The CGI variables indexed by CGI::Environment come first, in the order of CGI::Environment::hot_t, followed by Registry
+    items, Config parameters read while serving requests and, from #KNOWN_HEADERS on, response headers.
+  */
+
+  constexpr std::string_view knownKeys[] = {
+    "QUERY_STRING",
+    "REQUEST_METHOD",
+    "CONTENT_LENGTH",
+    "CONTENT_TYPE",
+    "HTTP_COOKIE",
+    "HTTP_HOST",
+    "SERVER_NAME",
+    "HTTPS",
+    "HTTP_HTTPS",
+    "HTTP_ACCEPT_ENCODING",
+    "REQUEST_URI",
+    "config",
+    "request",
+    "responsecache",
+    "sessionstore",
+    "sess_cookiename",
+    "session_expire",
+    "response_stream_high",
+    "response_stream_low",
+    "response_compression_level",
+    "response_compression_min",
+    "request_max_body",
+    "Content-Type",
+    "Content-Encoding",
+    "Content-Length",
+    "Content-Disposition",
+    "Vary",
+    "Cache-Control",
+    "Expires",
+    "Last-Modified",
+    "ETag",
+    "Location",
+    "Status",
+  };
+
+  constexpr int KNOWN_KEYS = sizeof knownKeys / sizeof knownKeys[0]; //!< Number of known keys
+  constexpr int KNOWN_ITEMS = 11; //!< Slot of the first Registry item in #knownKeys
+  constexpr int KNOWN_HEADERS = 22; //!< Slot of the first response header in #knownKeys
+
+  static_assert(knownKeys[KNOWN_ITEMS] == "config", "KNOWN_ITEMS must be the slot of the first Registry item");
+  static_assert(knownKeys[KNOWN_HEADERS] == "Content-Type", "KNOWN_HEADERS must be the slot of the first response header");
+
+  constexpr std::array<uint64_t, KNOWN_KEYS> makeKnownHashes() {
+    std::array<uint64_t, KNOWN_KEYS> t {};
+    for(int i = 0; i < KNOWN_KEYS; i++)
+      t[i] = hash(knownKeys[i]);
+    return t;
+  }
+
+  constexpr std::array<uint64_t, KNOWN_KEYS> knownHashes = makeKnownHashes(); //!< Hashes of #knownKeys, in the same order
+
+  /*! \brief Interned name of a parameter, header, registry item, etc.
+
+    Carries the name together with its #hash and its slot in #knownKeys (-1 if it is not one of them), so that lookups
+    taking a Key neither hash the name again nor compare strings for known names, and go straight to the slot.
+    Both are computed by the constructor, which is constexpr: a Key declared constexpr (see Common::Keys) costs nothing
+    at run time. Keys are implicitly made from literals and strings, hence they are accepted wherever names used to be.
+
+    \remark A Key refers to the characters of the name, it must not outlive them
+  */
+
+  class Key {
+  private:
+    std::string_view name; //!< The name
+    uint64_t h; //!< #hash of #name
+    int slot; //!< Index in #knownKeys, -1 if the name is not known
+
+    static constexpr int resolve(std::string_view name, uint64_t h) {
+      for(int i = 0; i < KNOWN_KEYS; i++)
+	if(knownHashes[i] == h and knownKeys[i] == name)
+	  return i;
+      return -1;
+    }
+
+  public:
+    //! \param[in] _name Name, it must outlive the key
+    constexpr Key(std::string_view _name) : name(_name), h(hash(_name)), slot(resolve(_name, h)) {}
+
+    //! \param[in] _name NUL terminated name, it must outlive the key
+    constexpr Key(const char* _name) : Key(std::string_view(_name)) {}
+
+    //! \param[in] _name Name, it must outlive the key
+    Key(const std::string& _name) : Key(std::string_view(_name)) {}
+
+    //! \return The name
+    constexpr std::string_view getName() const {
+      return name;
+    }
+
+    //! \return #hash of the name
+    constexpr uint64_t getHash() const {
+      return h;
+    }
+
+    //! \return Index of the name in #knownKeys or -1 if it is not known
+    constexpr int getSlot() const {
+      return slot;
+    }
+  };
+
+  //! Keys used by the framework itself, interned at compile time
+
+  namespace Keys {
+    constexpr Key CONFIG ("config");
+    constexpr Key REQUEST ("request");
+    constexpr Key RESPONSE_CACHE ("responsecache");
+    constexpr Key SESSION_STORE ("sessionstore");
+    constexpr Key SESS_COOKIENAME ("sess_cookiename");
+    constexpr Key SESSION_EXPIRE ("session_expire");
+    constexpr Key RESPONSE_STREAM_HIGH ("response_stream_high");
+    constexpr Key RESPONSE_STREAM_LOW ("response_stream_low");
+    constexpr Key RESPONSE_COMPRESSION_LEVEL ("response_compression_level");
+    constexpr Key RESPONSE_COMPRESSION_MIN ("response_compression_min");
+    constexpr Key REQUEST_MAX_BODY ("request_max_body");
+    constexpr Key CONTENT_TYPE ("Content-Type");
+    constexpr Key CONTENT_ENCODING ("Content-Encoding");
+    constexpr Key CONTENT_LENGTH ("Content-Length");
+    constexpr Key VARY ("Vary");
+  }
+
+  /*! \brief Cryptographically secure random bytes
+
+    ChaCha20 keystream of a generator kept per thread, keyed once from getrandom(2). No system call is made after that,
+    except to key the generator again in a child process after fork(), so that parent and child do not repeat each other.
+
+    \param[out] out Buffer to be filled
+    \param[in] length Number of bytes
+  */
+
+  void randomBytes(void* out, size_t length);
+
+  /*! \brief Flat, open addressing dictionary of string views
+
+    A cache friendly replacement for #Dict_t on the request path. Entries are kept in a single vector in insertion order and
+    indexed by a power of two table of slots using linear probing, hence inserting an entry does not allocate a node.
+    Neither keys nor values are copied, they are views into a buffer owned by the user of the dictionary
+    (the environment block, the decoded query string, etc.) which must outlive the dictionary.
+
+    The lookup interface mirrors #Dict_t: #find, #end, #count, #begin and iteration over pairs having first and second.
+    #clear retains the allocated memory so that an instance can be reused.
+  */
+
+  class FlatDict {
+  public:
+    typedef std::pair<std::string_view, std::string_view> value_type; //!< Single entry, key and value
+    typedef std::vector<value_type>::const_iterator iterator; //!< Iterator over entries, in insertion order
+    typedef iterator const_iterator; //!< Entries are never modified through iterators
+
+  private:
+
+    //! Slot of the index table
+    struct slot_t {
+      uint32_t hash; //!< Lower 32 bits of the key hash, compared before the key itself
+      uint32_t index; //!< Index in #entries plus one, 0 marks an empty slot
+    };
+
+    std::vector<value_type> entries; //!< Entries in insertion order
+    std::vector<slot_t> slots; //!< Open addressing index, size is zero or a power of two
+    size_t mask; //!< slots.size() - 1
+
+    //! Returns the slot holding key or the empty slot where it should be inserted
+    slot_t& locate(std::string_view key, uint64_t h);
+
+    //! Doubles the index table and reinserts all entries
+    void grow();
+
+  public:
+
+    //! Constructor, nothing is allocated till the first insertion
+    FlatDict() : mask(0) {}
+
+    /*! \brief Inserts an entry
+      \remark Like std::map::insert, an existing entry is not overwritten
+      \param[in] key Key of the entry
+      \param[in] value Value of the entry
+      \return true if the entry was inserted, false if key was already present
+    */
+
+    bool insert(std::string_view key, std::string_view value);
+
+    /*! \brief Inserts an entry or overwrites the value of an existing one
+      \param[in] key Key of the entry
+      \param[in] value Value of the entry
+      \return FlatDict& for cascading operations
+    */
+
+    FlatDict& assign(std::string_view key, std::string_view value);
+
+    /*! \brief Finds an entry
+      \param[in] key Key to be searched
+      \return Iterator to the entry or #end if key is not present
+    */
+
+    iterator find(std::string_view key) const {
+      return find(key, hash(key));
+    }
+
+    /*! \brief Finds an entry whose hash is already known
+      \param[in] key Key to be searched
+      \param[in] h #hash of key, for instance Key::getHash
+      \return Iterator to the entry or #end if key is not present
+    */
+
+    iterator find(std::string_view key, uint64_t h) const;
+
+    //! \return 1 if key is present, 0 otherwise
+    size_t count(std::string_view key) const {
+      return find(key) != end();
+    }
+
+    //! \return Iterator to the first entry
+    iterator begin() const {
+      return entries.begin();
+    }
+
+    //! \return Iterator past the last entry
+    iterator end() const {
+      return entries.end();
+    }
+
+    //! \return Number of entries
+    size_t size() const {
+      return entries.size();
+    }
+
+    //! \return true if there are no entries
+    bool empty() const {
+      return entries.empty();
+    }
+
+    /*! \brief Reserves space for n entries
+      \param[in] n Number of entries
+    */
+
+    void reserve(size_t n);
+
+    //! Removes all entries, retaining the allocated memory
+    void clear();
+  };
+
+  /*! \brief Immutable dictionary of strings with cheap copies and versions
+
+    A hash array mapped trie: each level of the tree consumes 5 bits of the key hash, a node keeps a 32-bit bitmap of the
+    fragments present and a packed array of just those children, which are either entries or nodes of the next level.
+    Keys whose hashes are equal in all 64 bits end up together in a node past the last level, which is searched linearly.
+
+    Nodes and entries are never modified once built and are reference counted. Copying an instance copies a pointer,
+    and #set and #erase return a new version which shares everything but the path to the changed entry (a node per
+    level, at most 14) with the old one, which stays valid as it was. Versions may be read and derived from
+    in different threads at the same time.
+
+    Iteration order follows the hashes of the keys.
+  */
+
+  class PersistentDict {
+  public:
+    typedef std::pair<const std::string, std::string> value_type; //!< Single entry, key and value
+
+  private:
+
+    struct node_t;
+    typedef std::shared_ptr<const node_t> node_ptr_t;
+
+    //! Entry with the hash of its key
+    struct leaf_t {
+      uint64_t hash; //!< Common::hash of the key
+      value_type entry; //!< Key and value
+    };
+
+    typedef std::shared_ptr<const leaf_t> leaf_ptr_t;
+
+    //! Child of a node, exactly one of the two is set
+    struct child_t {
+      leaf_ptr_t leaf;
+      node_ptr_t node;
+    };
+
+    //! Level of the trie
+    struct node_t {
+      uint32_t bitmap; //!< Bit n is set if there is a child for hash fragment n, 0 past the last level
+      std::vector<child_t> children; //!< Children in order of their fragment
+    };
+
+    static const unsigned int BITS = 5; //!< Hash bits consumed per level
+    static const unsigned int MAX_DEPTH = (64 + BITS - 1) / BITS + 1; //!< Levels, including the one past the hash
+
+    node_ptr_t root; //!< Top level, NULL if there are no entries
+    size_t length; //!< Number of entries
+
+    PersistentDict(node_ptr_t _root, size_t _length) : root(_root), length(_length) {}
+
+    //! Returns node with leaf added at depth shift, or its entry replaced if the key is present
+    static node_ptr_t insert(const node_t* node, unsigned int shift, const leaf_ptr_t& leaf, bool& added);
+
+    //! Returns a node holding the leaves a and b, which differ in key, at depth shift
+    static node_ptr_t merge(const leaf_ptr_t& a, const leaf_ptr_t& b, unsigned int shift);
+
+    //! Returns node without key, NULL if nothing is left in it
+    static node_ptr_t remove(const node_ptr_t& node, unsigned int shift, std::string_view key, uint64_t h, bool& removed);
+
+  public:
+
+    //! Forward iterator over entries
+    class const_iterator {
+    private:
+      struct frame_t {
+	const node_t* node;
+	size_t index;
+      };
+
+      frame_t stack[MAX_DEPTH]; //!< Path from the root to the current entry
+      int depth; //!< Index of the top of #stack, -1 at the end
+
+      //! Moves from the position on top of #stack down or up to the next entry
+      void settle();
+
+    public:
+      //! Iterator at the end
+      const_iterator() : depth(-1) {}
+
+      //! Iterator at the first entry under root
+      explicit const_iterator(const node_t* root);
+
+      const value_type& operator*() const {
+	return stack[depth].node->children[stack[depth].index].leaf->entry;
+      }
+
+      const value_type* operator->() const {
+	return &**this;
+      }
+
+      const_iterator& operator++() {
+	stack[depth].index++;
+	settle();
+	return *this;
+      }
+
+      bool operator==(const const_iterator& other) const {
+	return depth == other.depth and (depth < 0 or (stack[depth].node == other.stack[depth].node and stack[depth].index == other.stack[depth].index));
+      }
+
+      bool operator!=(const const_iterator& other) const {
+	return not (*this == other);
+      }
+    };
+
+    typedef const_iterator iterator; //!< Entries are never modified through iterators
+
+    //! Constructor, an empty dictionary
+    PersistentDict() : length(0) {}
+
+    //! Builds a dictionary with the entries of a #Dict_t
+    explicit PersistentDict(const Dict_t& data);
+
+    /*! \brief Finds an entry
+      \param[in] key Key to be searched
+      \return Pointer to the entry, valid as long as a version holding it exists, or NULL if key is not present
+    */
+
+    const value_type* find(std::string_view key) const {
+      return find(key, hash(key));
+    }
+
+    /*! \brief Finds an entry whose hash is already known
+      \param[in] key Key to be searched
+      \param[in] h #hash of key, for instance Key::getHash
+      \return Pointer to the entry or NULL if key is not present
+    */
+
+    const value_type* find(std::string_view key, uint64_t h) const;
+
+    //! \return 1 if key is present, 0 otherwise
+    size_t count(std::string_view key) const {
+      return find(key) != NULL;
+    }
+
+    /*! \brief Inserts an entry or replaces the value of an existing one
+      \param[in] key Key of the entry
+      \param[in] value Value of the entry
+      \return New version with the entry, this one is left unchanged
+    */
+
+    PersistentDict set(std::string_view key, std::string_view value) const;
+
+    /*! \brief Removes an entry
+      \param[in] key Key of the entry
+      \return New version without the entry, this one is left unchanged
+    */
+
+    PersistentDict erase(std::string_view key) const;
+
+    //! \return Iterator to the first entry
+    const_iterator begin() const {
+      return const_iterator(root.get());
+    }
+
+    //! \return Iterator past the last entry
+    const_iterator end() const {
+      return const_iterator();
+    }
+
+    //! \return Number of entries
+    size_t size() const {
+      return length;
+    }
+
+    //! \return true if there are no entries
+    bool empty() const {
+      return not length;
+    }
+  };
+
   /*! \brief Configuration reader class
 
-    The applications configuration will be stored in a XML file which will be parsed using pugixml into a #Dict_t.
-    #operator[] gives access (read only) to each parameter.
+    The applications configuration will be stored in a XML file which will be parsed using pugixml. #operator[] gives
+    access (read only) to each parameter.
+
+    The parsed configuration is kept as a snapshot: a header, a table of entries sorted by key and a pool holding the
+    keys and values. The snapshot is written next to the XML file, so that the next process mmaps it instead of
+    parsing the XML again. It is reused as long as the XML file keeps its modification time and size, or, if only the
+    modification time changed, its #hash.
   */
 
   class Config {
   private:
 
-    //! Dicitonary to store parsed XML data
-    Dict_t data;
-    
+    //! Header of a snapshot
+    struct header_t {
+      char magic[8]; //!< "CGICONF" and a NUL
+      uint32_t version; //!< Layout of the snapshot, #VERSION
+      uint32_t count; //!< Number of entries
+      uint64_t length; //!< Size of the whole snapshot in bytes
+      int64_t mtime; //!< Modification time of the XML file in nanoseconds
+      uint64_t size; //!< Size of the XML file
+      uint64_t hash; //!< #hash of the XML file
+    };
+
+    //! Entry of the key table, offsets are from the start of the pool
+    struct entry_t {
+      uint32_t key; //!< Offset of the key
+      uint32_t keyLength; //!< Length of the key
+      uint32_t value; //!< Offset of the value
+      uint32_t valueLength; //!< Length of the value
+    };
+
+    static const uint32_t VERSION = 1; //!< Bumped whenever #header_t or #entry_t change
+
+    const char* image; //!< The snapshot, either mapped or held in #buffer
+    size_t imageLength; //!< Size of #image
+    bool mapped; //!< If #image is mapped from the snapshot file
+    std::vector<char> buffer; //!< Snapshot built from the XML file, or patched, when it is not mapped
+
+    //! Values of the parameters which are #knownKeys, data() is NULL if not configured
+    std::string_view known[KNOWN_KEYS];
+
+    //! \return Start of the pool in #image
+    const char* pool() const {
+      return image + sizeof(header_t) + reinterpret_cast<const header_t*>(image)->count * sizeof(entry_t);
+    }
+
+    //! Binary search of the key table, data() of the result is NULL if key is not found
+    std::string_view lookup(std::string_view key) const;
+
+    //! Maps the snapshot if it matches the XML file. May read the XML file into xml or fill #buffer on the way.
+    bool map(const std::string& snapshot, const std::string& filename, const struct stat& source, std::string& xml, bool& read);
+
+    //! Parses the XML file into #buffer
+    void compile(const std::string& xml, const struct stat& source);
+
+    //! Writes #image to the snapshot file, atomically replacing it. Failure is not an error, the XML is parsed next time.
+    void save(const std::string& snapshot) const;
+
   public:
 
     /*! \brief Constructor - the main function which does the parsing.
 
-      The whole parsing/processing occurs in the constructor (by calling pugixml's functions).
+      The whole parsing/processing occurs in the constructor (by calling pugixml's functions), unless the snapshot of a
+      previous parse is still valid.
 
       \remark The following structure is assumed in the XML file:
       \verbatim
@@ -135,32 +632,62 @@ namespace Common {
         </moduleName>
       </config>
       \endverbatim
-      The configuration in #data will be stored as data[moduleName_moduleParameter1] = value1
+      The configuration will be stored as moduleName_moduleParameter1 = value1
 
       \param[in] filename Path to the XML file containing configuration
+      \param[in] snapshot Path to the snapshot, filename with .snapshot appended if empty
+      \throw Common::Exception with #E_CONFIG_LOAD if the XML file can not be read or parsed
      */
-    
-    Config(std::string filename);
 
-    /*! \brief Element access to parsed \<keys,values\> stored in #data
+    Config(std::string filename, std::string snapshot = "");
+
+    ~Config();
+
+    Config(const Config&) = delete;
+    Config& operator=(const Config&) = delete;
 
-      We don't need write access to configuration, hence the function returns a const std::string and not a reference or pointer
+    /*! \brief Element access to parsed \<keys,values\>
+
+      We don't need write access to configuration, hence the function returns a view into the snapshot. Values are
+      followed by a NUL in the pool, data() of the view can be handed to C functions.
 
       \param[in] key Element name (xml) or key name in the configuration
-      \return Value of the respective key in #data
-      \throw Common::Exception with #E_CONFIG_PARAM_NOT_FOUND if key is not found in #data
+      \return Value of the respective key, valid as long as the Config
+      \throw Common::Exception with #E_CONFIG_PARAM_NOT_FOUND if key is not found
     */
-    
-    const std::string operator[](std::string key) {
-      if(data.find(key) == data.end())
-	throw Common::Exception("Configuration parameter " + key + " not found", E_CONFIG_PARAM_NOT_FOUND, __LINE__, __FILE__);
-      return data[key];
+
+    std::string_view operator[](Key key) const {
+      std::optional<std::string_view> value = tryGetParam(key);
+      if(not value)
+	throw Common::Exception("Configuration parameter " + std::string(key.getName()) + " not found", E_CONFIG_PARAM_NOT_FOUND, __LINE__, __FILE__);
+      return *value;
     }
 
-    //! \sa #operator[]
-    
-    const std::string getParam(std::string key) {
-      return data[key];
+    /*! \sa #operator[]
+      \return Value of the respective key, empty if key is not found. The snapshot is not modified, hence the method is
+      safe to call from concurrently running workers.
+    */
+
+    std::string_view getParam(Key key) const {
+      std::optional<std::string_view> value = tryGetParam(key);
+      return value ? *value : std::string_view("", 0);
+    }
+
+    /*! \sa #operator[]
+      \return Value of the respective key, std::nullopt if key is not configured. Unlike #getParam this tells a
+      parameter configured empty from a missing one.
+    */
+
+    std::optional<std::string_view> tryGetParam(Key key) const {
+      std::string_view value = key.getSlot() >= 0 ? known[key.getSlot()] : lookup(key.getName());
+      if(not value.data())
+	return std::nullopt;
+      return value;
+    }
+
+    //! \return Number of configured parameters
+    size_t size() const {
+      return reinterpret_cast<const header_t*>(image)->count;
     }
   };
 
@@ -169,18 +696,57 @@ namespace Common {
     A class to store pointers to various types of objects etc with key name.
     The class supports two interfaces- singleton and the usual, multiple instances. \n
     In singleton method, once an instance is created, it will be persisted till the method to destroy the instance is called.
+    The singleton instance is per thread, so that concurrently served requests do not see each other's items.
+
+    Objects shared by the whole process (the configuration, caches, storage) are better registered once at startup as
+    services (#provide), which have a slot per type: #getService is then a single atomic load, from any thread, with no
+    lookup at all. Named items remain for objects which belong to a thread, such as the request being served.
 
     \coder{Nilesh G,nileshgr}
   */
 
   class Registry {
   private:
-    typedef std::map<std::string, void*> items_t; //!< Define items_t dictionary type
-    typedef std::pair<std::string, void*> item_t; //!< Define item_t, one single item type
-    items_t items; //!< Dictionary to store pointers to objects
-    static std::unique_ptr<Registry> instance; //!< Unique_ptr to store pointer to singleton instance
+
+    //! Stored item
+    struct item_t {
+      void* ptr; //!< The object, NULL once deleted
+      const void* type; //!< #typeOf the type it was added as
+    };
+
+    typedef std::map<std::string, item_t> items_t; //!< Define items_t dictionary type
+    items_t items; //!< Dictionary to store pointers to objects, other than those named by #knownKeys
+    item_t known[KNOWN_KEYS]; //!< Objects named by #knownKeys
+    static thread_local std::unique_ptr<Registry> instance; //!< Unique_ptr to store pointer to singleton instance of the thread
+
+    template<typename objtype>
+    static inline std::atomic<objtype*> services {NULL}; //!< %Service of type objtype \sa provide
+
+    template<typename objtype>
+    static inline thread_local objtype* pinned = NULL; //!< Overrides #services for the thread \sa pin
+
+    //! \return Address identifying objtype, the same in all translation units
+    template<typename objtype>
+    static const void* typeOf() {
+      static const char tag = 0;
+      return &tag;
+    }
+
+    /*! \brief Locates the storage of an item
+      \param[in] key Name of the item, names are not case sensitive
+      \param[in] create Whether to add an entry to #items if the item is not present
+      \return Slot in #known or #items, NULL if it is not present and create is false
+    */
+
+    item_t* locate(Key key, bool create);
 
   public:
+
+    //! Constructor, an empty registry
+    Registry() {
+      std::fill(known, known + KNOWN_KEYS, item_t {NULL, NULL});
+    }
+
     //! Static method to obtain instance
 
     static Registry& getInstance();
@@ -189,32 +755,89 @@ namespace Common {
 
     static void destroyInstance();
 
+    /*! \brief Registers the service of a type, for all threads
+      \remark Meant to be called at startup, before the workers start, and with NULL when the service goes away.
+      A later call replaces the service for subsequent lookups.
+      \tparam objtype Type the service is looked up by, for instance an interface it implements
+      \param service The service, NULL to withdraw it
+    */
+
+    template<typename objtype>
+    static void provide(objtype* service) {
+      services<objtype>.store(service, std::memory_order_release);
+    }
+
+    /*! \brief Pins the service of a type for the calling thread
+      \remark Lookups from the thread return the pinned service, even when another one is provided meanwhile, so that
+      work in progress sees one and the same object. See ConfigWatcher::Reader.
+      \param service The service, NULL to follow #provide again
+    */
+
+    template<typename objtype>
+    static void pin(objtype* service) {
+      pinned<objtype> = service;
+    }
+
+    //! \return The service pinned by the thread or registered for objtype, NULL if there is none \sa provide
+    template<typename objtype>
+    static objtype* findService() {
+      objtype* service = pinned<objtype>;
+      return service ? service : services<objtype>.load(std::memory_order_acquire);
+    }
+
+    /*! \brief Retrieves the service registered for a type
+      \tparam objtype Type the service was registered as
+      \return Reference to the service
+      \throw Common::Exception with #E_REGISTRY_ITEM_NOT_FOUND if there is none \sa provide
+    */
+
+    template<typename objtype>
+    static objtype& getService() {
+      objtype* service = findService<objtype>();
+      if(not service)
+	throw Common::Exception("No service of the requested type in registry", E_REGISTRY_ITEM_NOT_FOUND, __LINE__, __FILE__);
+      return *service;
+    }
+
     /*! \brief Method to add item
       \param name Name of item to be added
-      \param ptr Pointer to item to be stored
+      \param ptr Pointer to item to be stored, its type is recorded and checked by #getItem
       \return Registry& for cascading operations
     */
 
-    Registry& addItem(std::string name, void* ptr) {
-      std::transform(name.begin(), name.end(), name.begin(), (int (*)(int))std::tolower);
-      items[name] = ptr;
+    template<typename objtype>
+    Registry& addItem(Key name, objtype* ptr) {
+      *locate(name, true) = item_t {ptr, typeOf<objtype>()};
       return *this;
     }
 
+    /*! \brief Tells if an item is present
+      \param name Name of the item
+      \return true if name is found in items
+    */
+
+    bool hasItem(Key name) {
+      item_t* item = locate(name, false);
+      return item and item->ptr;
+    }
+
     /*! \brief Templated function to retrieve item
       \param name Name of item to be returned
-      \tparam objtype Type of the object required as return type. dynamic_cast will be used.
-      \return Reference to dynamic_cast of objtype
-      \throw Common::Exception if name is not found in items
+      \tparam objtype Type of the object required as return type. It must be the type the item was added as,
+      items added as void* are returned as any type.
+      \return Reference to the item
+      \throw Common::Exception with #E_REGISTRY_ITEM_NOT_FOUND if name is not found in items
+      \throw Common::Exception with #E_REGISTRY_TYPE_MISMATCH if the item was added as another type
     */
       
     template<typename objtype>
-    objtype& getItem(std::string name) {
-      std::transform(name.begin(), name.end(), name.begin(), (int (*)(int)) std::tolower);
-      items_t::iterator i;
-      if((i = items.find(name)) == items.end())
-	throw Common::Exception("Item: " + name + " not found in registry", E_REGISTRY_ITEM_NOT_FOUND, __LINE__, __FILE__);
-      return *(reinterpret_cast <objtype*> (i->second));
+    objtype& getItem(Key name) {
+      item_t* item = locate(name, false);
+      if(not item or not item->ptr)
+	throw Common::Exception("Item: " + std::string(name.getName()) + " not found in registry", E_REGISTRY_ITEM_NOT_FOUND, __LINE__, __FILE__);
+      if(item->type != typeOf<objtype>() and item->type != typeOf<void>())
+	throw Common::Exception("Item: " + std::string(name.getName()) + " was added to registry as another type", E_REGISTRY_TYPE_MISMATCH, __LINE__, __FILE__);
+      return *static_cast<objtype*>(item->ptr);
     }
 
     /*! \brief Method to delete item
@@ -222,10 +845,115 @@ namespace Common {
       \return Registry& for cascading operations
     */
       
-    Registry& deleteItem(std::string name) {
-      items.erase(name);
+    Registry& deleteItem(Key name) {
+      item_t* item = locate(name, false);
+      if(item)
+	item->ptr = NULL;
       return *this;
     }
   };
+
+  /*! \brief Reloads the configuration when its file changes
+
+    A thread watches the directory of the XML file with inotify(7), so that editors replacing the file are noticed too,
+    and parses the file again when it has been written. The new Config is published with an atomic swap and provided as
+    the Registry service, a file which fails to parse leaves the current one in place.
+
+    Readers never lock: a Reader announces the epoch it enters at and pins the current Config for its thread till it
+    leaves, typically for the duration of one request. A replaced Config is deleted once no Reader is left which entered
+    before the replacement, epoch based reclamation in the manner of RCU.
+
+    \remark Threads which do not enter a Reader must not use the configuration while it may be reloaded.
+  */
+
+  class ConfigWatcher {
+  private:
+
+    //! Epoch a reader entered at, 0 while it is outside
+    struct slot_t {
+      std::atomic<uint64_t> epoch {0};
+    };
+
+    //! Replaced configuration, to be deleted once no reader entered before #epoch
+    struct retired_t {
+      uint64_t epoch; //!< Value of #epoch after the replacement
+      Config* config; //!< The replaced configuration
+    };
+
+    std::string filename; //!< Path to the XML file
+    std::atomic<Config*> current; //!< Configuration in effect
+    std::atomic<uint64_t> epoch {1}; //!< Incremented on every replacement
+    std::mutex slotsLock; //!< Guards #slots, taken when readers come and go and while reclaiming, never per request
+    std::list<slot_t> slots; //!< One per Reader
+    std::vector<retired_t> retired; //!< Used by the watching thread only
+    int notifier; //!< inotify descriptor
+    int stopper; //!< eventfd which stops the watching thread
+    std::thread watcher; //!< The watching thread
+
+    //! Body of the watching thread
+    void watch();
+
+    //! Parses the file and publishes the result
+    void reload();
+
+    //! Deletes the retired configurations which no reader can hold anymore
+    void reclaim();
+
+  public:
+
+    /*! \brief Read side of the watcher, one per thread using the configuration
+
+      The thread surrounds each unit of work, such as a request, with #enter and #leave. In between, the Config it got
+      stays alive and is what Registry::findService<Config> returns on the thread.
+    */
+
+    class Reader {
+    private:
+      ConfigWatcher& owner; //!< The watcher
+      slot_t* slot; //!< Epoch announced by this reader
+
+    public:
+      //! \param[in] _owner Watcher whose configuration is read
+      Reader(ConfigWatcher& _owner);
+
+      //! Destructor, leaves if need be
+      ~Reader();
+
+      Reader(const Reader&) = delete;
+      Reader& operator=(const Reader&) = delete;
+
+      //! \return The configuration in effect, pinned till #leave
+      Config& enter() {
+	slot->epoch.store(owner.epoch.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+	Config* config = owner.current.load(std::memory_order_seq_cst);
+	Registry::pin(config);
+	return *config;
+      }
+
+      //! Releases the configuration returned by #enter
+      void leave() {
+	Registry::pin<Config>(NULL);
+	slot->epoch.store(0, std::memory_order_release);
+      }
+    };
+
+    /*! \brief Constructor, loads the configuration, provides it and starts watching
+      \param[in] _filename Path to the XML file \sa Config::Config
+      \throw Common::Exception with #E_CONFIG_LOAD if the configuration cannot be loaded or the file cannot be watched
+    */
+
+    ConfigWatcher(std::string _filename);
+
+    //! Destructor, stops watching and withdraws the configuration. No Reader may be left.
+    ~ConfigWatcher();
+
+    ConfigWatcher(const ConfigWatcher&) = delete;
+    ConfigWatcher& operator=(const ConfigWatcher&) = delete;
+
+    //! \return The configuration in effect, for threads which are not readers while nothing is reloaded, such as at startup
+    Config& get() const {
+      return *current.load(std::memory_order_acquire);
+    }
+  };
 }
 #endif
@@ -1,29 +1,220 @@
 #include <common/common.hpp>
 #include <contrib/pugixml/pugixml.hpp>
 #include <string>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 /*! \file config.cpp
   \brief Implementation of Common::Config
 */
 
 namespace Common {
-  Config::Config(std::string filename) {
+
+  static const char MAGIC[8] = "CGICONF";
+
+  static int64_t mtimeOf(const struct stat& st) {
+    return (int64_t) st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+  }
+
+  static bool readFile(const std::string& filename, std::string& out) {
+    int fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+      return false;
+    char chunk[65536];
+    ssize_t n;
+    out.clear();
+    while((n = read(fd, chunk, sizeof chunk)) > 0 or (n < 0 and errno == EINTR))
+      if(n > 0)
+	out.append(chunk, n);
+    close(fd);
+    return n == 0;
+  }
+
+  Config::Config(std::string filename, std::string snapshot) : image(NULL), imageLength(0), mapped(false) {
+    if(snapshot.empty())
+      snapshot = filename + ".snapshot";
+
+    struct stat source;
+    if(stat(filename.c_str(), &source) != 0)
+      throw Common::Exception("Error reading configuration file: " + filename + ": " + std::strerror(errno), E_CONFIG_LOAD, __LINE__, __FILE__);
+
+    std::string xml;
+    bool read = false;
+    if(not map(snapshot, filename, source, xml, read)) {
+      if(buffer.empty()) { // Nothing to reuse, parse the XML
+	if(not read and not readFile(filename, xml))
+	  throw Common::Exception("Error reading configuration file: " + filename + ": " + std::strerror(errno), E_CONFIG_LOAD, __LINE__, __FILE__);
+	compile(xml, source);
+      }
+      image = buffer.data();
+      imageLength = buffer.size();
+      save(snapshot);
+    }
+
+    for(int i = 0; i < KNOWN_KEYS; i++)
+      known[i] = lookup(knownKeys[i]);
+  }
+
+  Config::~Config() {
+    if(mapped)
+      munmap(const_cast<char*>(image), imageLength);
+  }
+
+  bool Config::map(const std::string& snapshot, const std::string& filename, const struct stat& source, std::string& xml, bool& read) {
+    int fd = open(snapshot.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+      return false;
+    struct stat st;
+    void* p = MAP_FAILED;
+    if(fstat(fd, &st) == 0 and (size_t) st.st_size >= sizeof(header_t))
+      p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(p == MAP_FAILED)
+      return false;
+
+    const char* start = static_cast<const char*>(p);
+    const header_t* header = static_cast<const header_t*>(p);
+    size_t length = st.st_size;
+    bool valid = std::memcmp(header->magic, MAGIC, sizeof MAGIC) == 0 and header->version == VERSION and
+      header->length == length and header->count <= (length - sizeof(header_t)) / sizeof(entry_t);
+
+    /*
+     * Every entry has to lie within the pool and be NUL terminated, as callers take data() for a C string, and the keys
+     * have to be strictly sorted for the binary search of lookup, so that lookups need no checks
+     */
+
+    if(valid) {
+      const entry_t* entries = reinterpret_cast<const entry_t*>(start + sizeof(header_t));
+      const char* pool = start + sizeof(header_t) + header->count * sizeof(entry_t);
+      size_t poolLength = length - sizeof(header_t) - header->count * sizeof(entry_t);
+      std::string_view previous;
+      for(uint32_t i = 0; valid and i < header->count; i++) {
+	valid = (uint64_t) entries[i].key + entries[i].keyLength < poolLength and
+	  (uint64_t) entries[i].value + entries[i].valueLength < poolLength and
+	  pool[entries[i].key + entries[i].keyLength] == '\0' and pool[entries[i].value + entries[i].valueLength] == '\0';
+	if(valid) {
+	  std::string_view key (pool + entries[i].key, entries[i].keyLength);
+	  valid = i == 0 or previous < key;
+	  previous = key;
+	}
+      }
+    }
+
+    /*
+     * Touched or replaced with a copy, the content decides and the snapshot is saved again with the new time.
+     * So does a file modified no earlier than the snapshot was written: timestamps are coarser than nanoseconds and a
+     * write right after the snapshot may have left the time as it was.
+     */
+
+    bool touched = valid and (header->mtime != mtimeOf(source) or mtimeOf(source) >= mtimeOf(st));
+    if(touched)
+      valid = header->size == (uint64_t) source.st_size and (read = readFile(filename, xml)) and hash(xml) == header->hash;
+    else
+      valid = valid and header->size == (uint64_t) source.st_size;
+
+    if(valid and touched) {
+      buffer.assign(start, start + length);
+      reinterpret_cast<header_t*>(buffer.data())->mtime = mtimeOf(source);
+    }
+    if(not valid or touched) {
+      munmap(p, length);
+      return false;
+    }
+    image = start;
+    imageLength = length;
+    mapped = true;
+    return true;
+  }
+
+  void Config::compile(const std::string& xml, const struct stat& source) {
     pugi::xml_document doc;
-    pugi::xml_parse_result res = doc.load(filename.c_str());
+    pugi::xml_parse_result res = doc.load_buffer(xml.data(), xml.size());
 
     if(not res)
       throw Common::Exception(std::string("Error parsing configuration file: ").append(res.description()), E_CONFIG_LOAD, __LINE__, __FILE__);
 
     pugi::xml_node root = doc.child("config"); // Getting the root node
+    if(not root) // Such as a file caught while it is being rewritten
+      throw Common::Exception("Configuration file has no config element", E_CONFIG_LOAD, __LINE__, __FILE__);
+    Dict_t data; // Sorted by key, as the key table has to be
 
-    for(pugi::xml_node moduleName = root.first_child(); moduleName; moduleName = root.next_sibling()) {
-      std::string key = moduleName.name();
-      key += "_";
-      for(pugi::xml_node moduleParameter = moduleName.first_child(); moduleParameter; moduleParameter = moduleName.next_sibling()) {
-	key += moduleParameter.name();
-	std::string value = moduleParameter.value();
-	data[key] = value;
-      }
+    for(pugi::xml_node moduleName = root.first_child(); moduleName; moduleName = moduleName.next_sibling()) {
+      std::string prefix = moduleName.name();
+      prefix += "_";
+      for(pugi::xml_node moduleParameter = moduleName.first_child(); moduleParameter; moduleParameter = moduleParameter.next_sibling())
+	data[prefix + moduleParameter.name()] = moduleParameter.child_value();
+    }
+
+    // Keys and values are NUL terminated in the pool
+
+    size_t poolOffset = sizeof(header_t) + data.size() * sizeof(entry_t), poolLength = 0;
+    for(Dict_t::const_iterator i = data.begin(); i != data.end(); i++)
+      poolLength += i->first.size() + i->second.size() + 2;
+    if(poolLength > UINT32_MAX)
+      throw Common::Exception("Configuration is too large", E_CONFIG_LOAD, __LINE__, __FILE__);
+
+    buffer.assign(poolOffset + poolLength, 0);
+    header_t* header = reinterpret_cast<header_t*>(buffer.data());
+    std::memcpy(header->magic, MAGIC, sizeof MAGIC);
+    header->version = VERSION;
+    header->count = data.size();
+    header->length = buffer.size();
+    header->mtime = mtimeOf(source);
+    header->size = source.st_size;
+    header->hash = hash(xml);
+
+    entry_t* entry = reinterpret_cast<entry_t*>(buffer.data() + sizeof(header_t));
+    char* pool = buffer.data() + poolOffset;
+    uint32_t offset = 0;
+    for(Dict_t::const_iterator i = data.begin(); i != data.end(); i++, entry++) {
+      entry->key = offset;
+      entry->keyLength = i->first.size();
+      std::memcpy(pool + offset, i->first.data(), i->first.size());
+      offset += i->first.size() + 1;
+      entry->value = offset;
+      entry->valueLength = i->second.size();
+      std::memcpy(pool + offset, i->second.data(), i->second.size());
+      offset += i->second.size() + 1;
+    }
+  }
+
+  void Config::save(const std::string& snapshot) const {
+    std::string temporary = snapshot + ".XXXXXX";
+    int fd = mkstemp(&temporary[0]); // Readable by the owner only, the configuration may hold keys
+    if(fd < 0)
+      return;
+    size_t written = 0;
+    while(written < imageLength) {
+      ssize_t n = write(fd, image + written, imageLength - written);
+      if(n < 0 and errno == EINTR)
+	continue;
+      if(n <= 0)
+	break;
+      written += n;
+    }
+    if(close(fd) != 0 or written != imageLength or rename(temporary.c_str(), snapshot.c_str()) != 0)
+      unlink(temporary.c_str());
+  }
+
+  std::string_view Config::lookup(std::string_view key) const {
+    const entry_t* entries = reinterpret_cast<const entry_t*>(image + sizeof(header_t));
+    const char* strings = pool();
+    size_t low = 0, high = size();
+
+    while(low < high) {
+      size_t middle = low + (high - low) / 2;
+      int order = std::string_view(strings + entries[middle].key, entries[middle].keyLength).compare(key);
+      if(order == 0)
+	return std::string_view(strings + entries[middle].value, entries[middle].valueLength);
+      if(order < 0)
+	low = middle + 1;
+      else
+	high = middle;
     }
+    return std::string_view();
   }
 }
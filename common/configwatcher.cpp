@@ -0,0 +1,140 @@
+#include <common/common.hpp>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+/*! \file configwatcher.cpp
+  \brief Implementation of Common::ConfigWatcher
+*/
+
+namespace Common {
+
+  ConfigWatcher::ConfigWatcher(std::string _filename) : filename(_filename), current(new Config(_filename)), notifier(-1), stopper(-1) {
+    size_t slash = filename.rfind('/');
+    std::string directory = slash == std::string::npos ? "." : slash ? filename.substr(0, slash) : "/";
+
+    notifier = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    stopper = eventfd(0, EFD_CLOEXEC);
+    if(notifier < 0 or stopper < 0 or inotify_add_watch(notifier, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+      std::string error = std::strerror(errno);
+      if(notifier >= 0)
+	close(notifier);
+      if(stopper >= 0)
+	close(stopper);
+      delete current.load();
+      throw Common::Exception("Error watching configuration file: " + filename + ": " + error, E_CONFIG_LOAD, __LINE__, __FILE__);
+    }
+
+    Registry::provide(current.load());
+    watcher = std::thread(&ConfigWatcher::watch, this);
+  }
+
+  ConfigWatcher::~ConfigWatcher() {
+    uint64_t one = 1;
+    if(write(stopper, &one, sizeof one) == sizeof one)
+      watcher.join();
+    else
+      watcher.detach(); // Cannot happen with an eventfd, but deleting a joinable thread would terminate
+    close(notifier);
+    close(stopper);
+
+    Config* config = current.load();
+    if(Registry::findService<Config>() == config)
+      Registry::provide<Config>(NULL);
+    delete config;
+    for(retired_t& r : retired)
+      delete r.config;
+  }
+
+  ConfigWatcher::Reader::Reader(ConfigWatcher& _owner) : owner(_owner) {
+    std::lock_guard<std::mutex> lock (owner.slotsLock);
+    owner.slots.emplace_back();
+    slot = &owner.slots.back();
+  }
+
+  ConfigWatcher::Reader::~Reader() {
+    leave();
+    std::lock_guard<std::mutex> lock (owner.slotsLock);
+    for(std::list<slot_t>::iterator i = owner.slots.begin(); i != owner.slots.end(); i++)
+      if(&*i == slot) {
+	owner.slots.erase(i);
+	break;
+      }
+  }
+
+  void ConfigWatcher::watch() {
+    size_t slash = filename.rfind('/');
+    std::string name = slash == std::string::npos ? filename : filename.substr(slash + 1);
+    alignas(inotify_event) char events[4096];
+
+    while(true) {
+      pollfd fds[2] = {{notifier, POLLIN, 0}, {stopper, POLLIN, 0}};
+      if(poll(fds, 2, retired.empty() ? -1 : 10) < 0 and errno != EINTR)
+	break;
+      if(fds[1].revents)
+	break;
+
+      // Several events may concern the file, it is parsed once for all of them
+
+      bool changed = false;
+      ssize_t length;
+      while((length = read(notifier, events, sizeof events)) > 0)
+	for(char* p = events; p < events + length; p += sizeof(inotify_event) + reinterpret_cast<inotify_event*>(p)->len) {
+	  inotify_event* event = reinterpret_cast<inotify_event*>(p);
+	  if(event->len and name == event->name)
+	    changed = true;
+	}
+      if(changed)
+	reload();
+      reclaim();
+    }
+  }
+
+  void ConfigWatcher::reload() {
+    Config* fresh;
+    try {
+      fresh = new Config(filename);
+    }
+    catch(Common::Exception& e) { // Possibly caught half written, the next write brings another event
+      std::fprintf(stderr, "Configuration not reloaded: %s\n", e.getCMessage());
+      return;
+    }
+    catch(std::exception& e) { // Such as std::bad_alloc, which would end the watcher thread and the process with it
+      std::fprintf(stderr, "Configuration not reloaded: %s\n", e.what());
+      return;
+    }
+
+    Config* replaced = current.exchange(fresh, std::memory_order_seq_cst);
+    Registry::provide(fresh);
+    retired.push_back(retired_t {epoch.fetch_add(1, std::memory_order_seq_cst) + 1, replaced});
+  }
+
+  void ConfigWatcher::reclaim() {
+    if(retired.empty())
+      return;
+
+    // Readers which entered before the oldest pending replacement, they may still hold what it replaced
+
+    uint64_t oldest = epoch.load(std::memory_order_seq_cst);
+    {
+      std::lock_guard<std::mutex> lock (slotsLock);
+      for(slot_t& s : slots) {
+	uint64_t entered = s.epoch.load(std::memory_order_seq_cst);
+	if(entered and entered < oldest)
+	  oldest = entered;
+      }
+    }
+
+    std::vector<retired_t>::iterator keep = retired.begin();
+    for(retired_t& r : retired)
+      if(r.epoch <= oldest)
+	delete r.config;
+      else
+	*keep++ = r;
+    retired.erase(keep, retired.end());
+  }
+}
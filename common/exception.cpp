@@ -37,7 +37,8 @@ namespace Common {
     // Format: [Error X] on line #L of file F
     std::stringstream s;
     s << "[" << getMessage() << "]" << " on line #" << getLineNo() << " of file " << getFileName();
-    return s.str().c_str();
+    cmessage = s.str();
+    return cmessage.c_str();
   }
 
   Exception::Exception(std::string _message, int _code, unsigned int _line, const char *_file) {
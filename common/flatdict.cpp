@@ -0,0 +1,71 @@
+#include <common/common.hpp>
+
+/*! \file flatdict.cpp
+  \brief Implementation of Common::FlatDict
+*/
+
+namespace Common {
+
+  FlatDict::slot_t& FlatDict::locate(std::string_view key, uint64_t h) {
+    for(size_t i = h & mask; ; i = (i + 1) & mask) {
+      slot_t& s = slots[i];
+      if(not s.index or (s.hash == (uint32_t) h and entries[s.index - 1].first == key))
+	return s;
+    }
+  }
+
+  void FlatDict::grow() {
+    std::vector<slot_t> old (slots.size() ? slots.size() * 2 : 16, slot_t {0, 0});
+    slots.swap(old);
+    mask = slots.size() - 1;
+
+    // Reinsert without comparing keys, they are unique already
+
+    for(const slot_t& s : old)
+      if(s.index) {
+	size_t i = s.hash & mask;
+	while(slots[i].index)
+	  i = (i + 1) & mask;
+	slots[i] = s;
+      }
+  }
+
+  bool FlatDict::insert(std::string_view key, std::string_view value) {
+    if((entries.size() + 1) * 2 > slots.size()) // Load factor is kept at or below 0.5
+      grow();
+    uint64_t h = hash(key);
+    slot_t& s = locate(key, h);
+    if(s.index)
+      return false;
+    entries.push_back(value_type(key, value));
+    s.hash = (uint32_t) h;
+    s.index = entries.size();
+    return true;
+  }
+
+  FlatDict& FlatDict::assign(std::string_view key, std::string_view value) {
+    if(not insert(key, value))
+      entries[locate(key, hash(key)).index - 1].second = value;
+    return *this;
+  }
+
+  FlatDict::iterator FlatDict::find(std::string_view key, uint64_t h) const {
+    if(entries.empty())
+      return end();
+    for(size_t i = h & mask; slots[i].index; i = (i + 1) & mask)
+      if(slots[i].hash == (uint32_t) h and entries[slots[i].index - 1].first == key)
+	return entries.begin() + (slots[i].index - 1);
+    return end();
+  }
+
+  void FlatDict::reserve(size_t n) {
+    entries.reserve(n);
+    while(n * 2 > slots.size())
+      grow();
+  }
+
+  void FlatDict::clear() {
+    entries.clear();
+    std::fill(slots.begin(), slots.end(), slot_t {0, 0});
+  }
+}
@@ -0,0 +1,190 @@
+#include <common/common.hpp>
+
+/*! \file persistentdict.cpp
+  \brief Implementation of Common::PersistentDict
+*/
+
+namespace Common {
+
+  /*
+   * Every function below builds new nodes and leaves the ones it was given alone. A node holding a single entry
+   * below the root is folded into its parent by remove(), so that a trie has the same shape however it was built.
+   */
+
+  static inline uint32_t fragment(uint64_t h, unsigned int shift) {
+    return 1u << ((h >> shift) & 31);
+  }
+
+  static inline size_t position(uint32_t bitmap, uint32_t bit) {
+    return __builtin_popcount(bitmap & (bit - 1));
+  }
+
+  PersistentDict::node_ptr_t PersistentDict::merge(const leaf_ptr_t& a, const leaf_ptr_t& b, unsigned int shift) {
+    std::shared_ptr<node_t> node = std::make_shared<node_t>();
+    if(shift >= 64) { // Past the hash, keys are kept in a list
+      node->bitmap = 0;
+      node->children = {child_t {a, NULL}, child_t {b, NULL}};
+      return node;
+    }
+    uint32_t bitA = fragment(a->hash, shift), bitB = fragment(b->hash, shift);
+    node->bitmap = bitA | bitB;
+    if(bitA == bitB)
+      node->children = {child_t {NULL, merge(a, b, shift + BITS)}};
+    else if(bitA < bitB)
+      node->children = {child_t {a, NULL}, child_t {b, NULL}};
+    else
+      node->children = {child_t {b, NULL}, child_t {a, NULL}};
+    return node;
+  }
+
+  PersistentDict::node_ptr_t PersistentDict::insert(const node_t* node, unsigned int shift, const leaf_ptr_t& leaf, bool& added) {
+    std::shared_ptr<node_t> copy = std::make_shared<node_t>(*node); // Copies pointers to the children, not the children
+
+    if(shift >= 64) {
+      for(child_t& child : copy->children)
+	if(child.leaf->entry.first == leaf->entry.first) {
+	  child.leaf = leaf;
+	  return copy;
+	}
+      copy->children.push_back(child_t {leaf, NULL});
+      added = true;
+      return copy;
+    }
+
+    uint32_t bit = fragment(leaf->hash, shift);
+    size_t i = position(node->bitmap, bit);
+    if(not (node->bitmap & bit)) {
+      copy->bitmap |= bit;
+      copy->children.insert(copy->children.begin() + i, child_t {leaf, NULL});
+      added = true;
+    }
+    else {
+      child_t& child = copy->children[i];
+      if(child.node)
+	child.node = insert(child.node.get(), shift + BITS, leaf, added);
+      else if(child.leaf->entry.first == leaf->entry.first)
+	child.leaf = leaf;
+      else {
+	child.node = merge(child.leaf, leaf, shift + BITS);
+	child.leaf = NULL;
+	added = true;
+      }
+    }
+    return copy;
+  }
+
+  PersistentDict::node_ptr_t PersistentDict::remove(const node_ptr_t& node, unsigned int shift, std::string_view key, uint64_t h, bool& removed) {
+    size_t i;
+    uint32_t bit = 0;
+    if(shift >= 64) {
+      for(i = 0; i < node->children.size() and node->children[i].leaf->entry.first != key; i++);
+      if(i == node->children.size())
+	return node;
+    }
+    else {
+      bit = fragment(h, shift);
+      if(not (node->bitmap & bit))
+	return node;
+      i = position(node->bitmap, bit);
+    }
+
+    const child_t& child = node->children[i];
+    child_t replacement;
+    if(child.node) {
+      replacement.node = remove(child.node, shift + BITS, key, h, removed);
+      if(replacement.node == child.node)
+	return node;
+      if(replacement.node and replacement.node->children.size() == 1 and replacement.node->children[0].leaf) {
+	replacement.leaf = replacement.node->children[0].leaf; // Fold a lone entry into this level
+	replacement.node = NULL;
+      }
+    }
+    else if(child.leaf->entry.first != key)
+      return node;
+    removed = true;
+
+    std::shared_ptr<node_t> copy = std::make_shared<node_t>(*node);
+    if(replacement.leaf or replacement.node)
+      copy->children[i] = replacement;
+    else {
+      copy->children.erase(copy->children.begin() + i);
+      copy->bitmap &= ~bit;
+      if(copy->children.empty())
+	return NULL;
+    }
+    return copy;
+  }
+
+  PersistentDict::PersistentDict(const Dict_t& data) : length(0) {
+    for(Dict_t::const_iterator i = data.begin(); i != data.end(); i++)
+      *this = set(i->first, i->second);
+  }
+
+  const PersistentDict::value_type* PersistentDict::find(std::string_view key, uint64_t h) const {
+    const node_t* node = root.get();
+    for(unsigned int shift = 0; node; shift += BITS) {
+      if(shift >= 64) {
+	for(const child_t& child : node->children)
+	  if(child.leaf->entry.first == key)
+	    return &child.leaf->entry;
+	return NULL;
+      }
+      uint32_t bit = fragment(h, shift);
+      if(not (node->bitmap & bit))
+	return NULL;
+      const child_t& child = node->children[position(node->bitmap, bit)];
+      if(child.leaf)
+	return child.leaf->entry.first == key ? &child.leaf->entry : NULL;
+      node = child.node.get();
+    }
+    return NULL;
+  }
+
+  PersistentDict PersistentDict::set(std::string_view key, std::string_view value) const {
+    leaf_ptr_t leaf (new leaf_t {hash(key), value_type(std::string(key), std::string(value))});
+    if(not root) {
+      std::shared_ptr<node_t> node = std::make_shared<node_t>();
+      node->bitmap = fragment(leaf->hash, 0);
+      node->children.push_back(child_t {leaf, NULL});
+      return PersistentDict(node, 1);
+    }
+    bool added = false;
+    node_ptr_t node = insert(root.get(), 0, leaf, added);
+    return PersistentDict(node, length + added);
+  }
+
+  PersistentDict PersistentDict::erase(std::string_view key) const {
+    if(not root)
+      return *this;
+    bool removed = false;
+    node_ptr_t node = remove(root, 0, key, hash(key), removed);
+    return removed ? PersistentDict(node, length - 1) : *this;
+  }
+
+  /*
+   * Implementation of PersistentDict::const_iterator
+   */
+
+  PersistentDict::const_iterator::const_iterator(const node_t* root) : depth(-1) {
+    if(not root)
+      return;
+    stack[0] = frame_t {root, 0};
+    depth = 0;
+    settle();
+  }
+
+  void PersistentDict::const_iterator::settle() {
+    while(depth >= 0) {
+      frame_t& top = stack[depth];
+      if(top.index == top.node->children.size()) {
+	if(--depth >= 0)
+	  stack[depth].index++;
+	continue;
+      }
+      const child_t& child = top.node->children[top.index];
+      if(child.leaf)
+	return;
+      stack[++depth] = frame_t {child.node.get(), 0};
+    }
+  }
+}
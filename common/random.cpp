@@ -0,0 +1,116 @@
+#include <common/common.hpp>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <pthread.h>
+#include <sys/random.h>
+
+/*! \file random.cpp
+  \brief Implementation of Common::randomBytes
+*/
+
+namespace Common {
+
+  /*
+   * ChaCha20 (RFC 8439) with a 64-bit block counter and a 64-bit nonce, as in the original design by D. J. Bernstein.
+   * A 256-bit key from getrandom() and a block counter are all the state, a block yields 64 bytes of output.
+   */
+
+  namespace {
+    std::atomic<unsigned int> forks (0); // Incremented in the child by fork(), makes generators key themselves again
+
+    void afterFork() {
+      forks++;
+    }
+
+    inline uint32_t rotate(uint32_t v, int n) {
+      return (v << n) | (v >> (32 - n));
+    }
+
+    inline void quarterRound(uint32_t* x, int a, int b, int c, int d) {
+      x[a] += x[b]; x[d] = rotate(x[d] ^ x[a], 16);
+      x[c] += x[d]; x[b] = rotate(x[b] ^ x[c], 12);
+      x[a] += x[b]; x[d] = rotate(x[d] ^ x[a], 8);
+      x[c] += x[d]; x[b] = rotate(x[b] ^ x[c], 7);
+    }
+
+    struct generator_t {
+      uint32_t input[16]; //!< Constants, key, counter and nonce
+      unsigned char block[64]; //!< Output of the last block
+      size_t available; //!< Bytes of block not yet handed out
+      unsigned int generation; //!< Value of forks when keyed
+      bool keyed; //!< False until the first call on this thread
+
+      generator_t() : available(0), generation(0), keyed(false) {}
+
+      void key() {
+	static const uint32_t sigma[4] = {0x61707865, 0x3320646e, 0x79622d32, 0x6b206574}; // "expand 32-byte k"
+	static pthread_once_t once = PTHREAD_ONCE_INIT;
+	pthread_once(&once, [] { pthread_atfork(NULL, NULL, afterFork); });
+
+	unsigned char seed[32];
+	for(size_t got = 0; got < sizeof seed; ) {
+	  ssize_t n = getrandom(seed + got, sizeof seed - got, 0);
+	  if(n < 0) {
+	    if(errno == EINTR)
+	      continue;
+	    throw Exception("No entropy available from getrandom", E_RANDOM, __LINE__, __FILE__);
+	  }
+	  got += n;
+	}
+	std::memcpy(input, sigma, sizeof sigma);
+	std::memcpy(input + 4, seed, sizeof seed);
+	std::memset(input + 12, 0, 16); // Counter and nonce, the key is never reused
+	std::memset(seed, 0, sizeof seed);
+	available = 0;
+	generation = forks.load();
+	keyed = true;
+      }
+
+      void refill() {
+	uint32_t x[16];
+	std::memcpy(x, input, sizeof x);
+	for(int i = 0; i < 10; i++) {
+	  quarterRound(x, 0, 4, 8, 12);
+	  quarterRound(x, 1, 5, 9, 13);
+	  quarterRound(x, 2, 6, 10, 14);
+	  quarterRound(x, 3, 7, 11, 15);
+	  quarterRound(x, 0, 5, 10, 15);
+	  quarterRound(x, 1, 6, 11, 12);
+	  quarterRound(x, 2, 7, 8, 13);
+	  quarterRound(x, 3, 4, 9, 14);
+	}
+	for(int i = 0; i < 16; i++) {
+	  uint32_t v = x[i] + input[i];
+	  block[4 * i] = v;
+	  block[4 * i + 1] = v >> 8;
+	  block[4 * i + 2] = v >> 16;
+	  block[4 * i + 3] = v >> 24;
+	}
+	if(not ++input[12]) // 64-bit block counter
+	  input[13]++;
+	available = sizeof block;
+      }
+    };
+
+    thread_local generator_t generator;
+  }
+
+  void randomBytes(void* out, size_t length) {
+    if(not generator.keyed or generator.generation != forks.load(std::memory_order_relaxed))
+      generator.key();
+
+    unsigned char* p = static_cast<unsigned char*>(out);
+    while(length) {
+      if(not generator.available)
+	generator.refill();
+      size_t n = std::min(length, generator.available);
+      unsigned char* source = generator.block + sizeof generator.block - generator.available;
+      std::memcpy(p, source, n);
+      std::memset(source, 0, n); // Handed out bytes are not kept
+      generator.available -= n;
+      p += n;
+      length -= n;
+    }
+  }
+}
@@ -7,7 +7,17 @@
 #include <cgi/cgi.hpp>
 
 namespace Common {
-  std::unique_ptr<Registry> Registry::instance; // Definition of static data member
+  constexpr bool lowerCaseItems() {
+    for(int i = KNOWN_ITEMS; i < KNOWN_HEADERS; i++)
+      for(char c : knownKeys[i])
+	if(c >= 'A' and c <= 'Z')
+	  return false;
+    return true;
+  }
+
+  static_assert(lowerCaseItems(), "Registry::locate relies on the names from KNOWN_ITEMS to KNOWN_HEADERS being lower case");
+
+  thread_local std::unique_ptr<Registry> Registry::instance; // Definition of static data member
 
   Registry& Registry::getInstance() {
     if(!instance.get())
@@ -18,4 +28,26 @@ namespace Common {
   void Registry::destroyInstance() {
     instance.reset();
   }
+
+  Registry::item_t* Registry::locate(Key key, bool create) {
+    // Only the names from KNOWN_ITEMS to KNOWN_HEADERS are lower case, the others are looked up as any other name
+
+    int slot = key.getSlot();
+    if(slot >= KNOWN_ITEMS and slot < KNOWN_HEADERS)
+      return &known[slot];
+
+    std::string name (key.getName());
+    std::transform(name.begin(), name.end(), name.begin(), (int (*)(int)) std::tolower);
+    slot = Key(name).getSlot();
+    if(slot >= KNOWN_ITEMS and slot < KNOWN_HEADERS)
+      return &known[slot];
+
+    items_t::iterator i = items.find(name);
+    if(i == items.end()) {
+      if(not create)
+	return NULL;
+      i = items.insert(items_t::value_type(name, item_t {NULL, NULL})).first;
+    }
+    return &i->second;
+  }
 }
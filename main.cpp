@@ -0,0 +1,28 @@
+#include <cgi/cgi.hpp>
+#include <cstdio>
+
+/*! \file main.cpp
+  \brief FastCGI entry point
+
+  Usage: cxxcms [path to configuration file]\n
+  The configuration file defaults to config.xml in the working directory.
+*/
+
+/*! \brief Request handler
+
+  Dispatching to modules is yet to be written, an empty page is served till then.
+*/
+
+static void handle(CGI::Request&, CGI::Response&) {
+}
+
+int main(int argc, char** argv) {
+  try {
+    CGI::Server server (argc > 1 ? argv[1] : "config.xml", handle);
+    return server.run();
+  }
+  catch(Common::Exception e) {
+    std::fprintf(stderr, "%s\n", e.getCMessage());
+    return 1;
+  }
+}
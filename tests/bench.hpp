@@ -0,0 +1,57 @@
+#ifndef TESTS_BENCH_HPP
+#define TESTS_BENCH_HPP
+
+#include <common/common.hpp>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <unistd.h>
+
+/*! \file bench.hpp
+  \brief Helpers shared by the benchmarks in tests/
+
+  Every benchmark is a program of its own, built as shown in its file comment and run without arguments unless stated
+  otherwise. Numbers are printed on stdout, one line per case.
+*/
+
+namespace Bench {
+
+  typedef std::chrono::steady_clock::time_point time_point_t; //!< Start of a measurement
+
+  //! \return Current time, to be passed to #since
+  inline time_point_t now() {
+    return std::chrono::steady_clock::now();
+  }
+
+  //! \return Seconds elapsed since start
+  inline double since(time_point_t start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  }
+
+  //! Keeps the computation of value from being optimized away
+  template<typename T>
+  inline void keep(const T& value) {
+    asm volatile("" : : "g"(&value) : "memory");
+  }
+
+  /*! \brief Loads a configuration and provides it as the Common::Config service
+    \param[in] parameters XML inside the config element, for instance "<session><expire>3600</expire></session>"
+    \return The configuration, it must outlive its use
+  */
+
+  inline std::unique_ptr<Common::Config> config(const std::string& parameters) {
+    std::string path = "/tmp/cxxcms-bench-" + std::to_string(getpid()) + ".xml";
+    {
+      std::ofstream out (path);
+      out << "<config>" << parameters << "</config>\n";
+    }
+    std::unique_ptr<Common::Config> loaded (new Common::Config(path));
+    unlink(path.c_str()); // A mapped snapshot stays readable once unlinked
+    unlink((path + ".snapshot").c_str());
+    Common::Registry::provide(loaded.get());
+    return loaded;
+  }
+}
+
+#endif
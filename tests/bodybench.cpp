@@ -0,0 +1,64 @@
+#include <cgi/cgi.hpp>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include "bench.hpp"
+#include "fcgistub.hpp"
+
+extern "C" int FCGI_getchar(void); // As declared by fcgi_stdio.h, which would turn printf into FCGI_printf
+
+/*! \file bodybench.cpp
+  \brief Benchmark of reading a request body with CGI::BodyStream
+
+  Throughput of reading 1 KB, 1 MB and 100 MB bodies a byte at a time with getchar, as Request did before, and with
+  BodyStream::read (into one buffer) and BodyStream::next (chunk by chunk, as a handler consuming an upload does).
+  The body comes from memory through tests/fcgistub.cpp, hence this is the cost of the reading itself, not the
+  throughput of a socket.
+
+  Build, from the top directory:\n
+  g++ -O2 -std=c++17 -I. tests/bodybench.cpp tests/fcgistub.cpp cgi/body.cpp common/exception.cpp
+*/
+
+int main() {
+  for(size_t length : {(size_t) 1024, (size_t) 1 << 20, (size_t) 100 << 20}) {
+    std::string body (length, 'x');
+    int repeats = length < 4096 ? 20000 : length < (2 << 20) ? 200 : 3;
+    std::unique_ptr<char[]> buffer (new char[length]);
+
+    Bench::time_point_t start = Bench::now();
+    for(int r = 0; r < repeats; r++) {
+      FcgiStub::setInput(body.data(), length);
+      for(size_t i = 0; i < length; i++)
+	buffer[i] = FCGI_getchar();
+      Bench::keep(buffer);
+    }
+    double bytewise = Bench::since(start);
+
+    start = Bench::now();
+    for(int r = 0; r < repeats; r++) {
+      FcgiStub::setInput(body.data(), length);
+      CGI::BodyStream stream (length);
+      stream.read(buffer.get(), length);
+      Bench::keep(buffer);
+    }
+    double whole = Bench::since(start);
+
+    start = Bench::now();
+    size_t total = 0;
+    for(int r = 0; r < repeats; r++) {
+      FcgiStub::setInput(body.data(), length);
+      CGI::BodyStream stream (length);
+      const char* chunk;
+      size_t n;
+      while((n = stream.next(chunk)))
+	total += n;
+    }
+    double chunked = Bench::since(start);
+    Bench::keep(total);
+
+    double megabytes = (double) length * repeats / (1 << 20);
+    std::printf("%9zu bytes: getchar %6.0f MB/s  read %6.0f MB/s  next %6.0f MB/s\n", length, megabytes / bytewise,
+		megabytes / whole, megabytes / chunked);
+  }
+  return 0;
+}
@@ -0,0 +1,102 @@
+#include <common/common.hpp>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+/*! \file configwatcher.cpp
+  \brief Reload test of Common::ConfigWatcher
+
+  Readers loop over enter/leave, as the workers of CGI::Server do per request, while the configuration file is rewritten
+  underneath them, alternately in place and replaced by rename. Every reader checks that the parameters it reads between
+  enter and leave come from one and the same configuration, and the last rewrite has to be in effect at the end.
+  Run under ThreadSanitizer or AddressSanitizer to catch a Config deleted while a reader still uses it.
+
+  Build, from the top directory, with the sources of common/ and contrib/pugixml/pugixml.cpp:\n
+  g++ -std=c++17 -I. -DPUGIXML_NO_STL -fsanitize=thread tests/configwatcher.cpp common/[a-z]*.cpp contrib/pugixml/pugixml.cpp -lpthread
+
+  Usage: a.out [directory for the configuration file, /tmp by default]\n
+  Returns 0 on success, 1 if a check failed.
+*/
+
+static const int READERS = 8; //!< Reader threads
+static const int RELOADS = 300; //!< Rewrites of the configuration file
+
+/*! \brief Writes a configuration in which test_a, test_b and session_expire all equal generation
+  \param[in] path Path of the configuration file
+  \param[in] generation Value of the parameters
+  \param[in] replace Whether to write a temporary file renamed over path, rather than rewriting path in place
+*/
+
+static void writeConfig(const std::string& path, int generation, bool replace) {
+  std::string target = replace ? path + ".tmp" : path;
+  {
+    std::ofstream out (target);
+    out << "<config><test><a>" << generation << "</a>";
+    for(int i = 0; i < 20; i++) // Makes a rewrite in place take long enough to be caught half written
+      out << "<p" << i << ">filler</p" << i << ">";
+    out << "<b>" << generation << "</b></test><session><expire>" << generation << "</expire></session></config>\n";
+  }
+  if(replace)
+    rename(target.c_str(), path.c_str());
+}
+
+int main(int argc, char** argv) {
+  std::string path = std::string(argc > 1 ? argv[1] : "/tmp") + "/configwatcher-test.xml";
+  writeConfig(path, 0, true);
+
+  std::atomic<bool> stop {false};
+  std::atomic<long> requests {0}, failures {0};
+  int last = -1;
+
+  try {
+    Common::ConfigWatcher watcher (path);
+    std::vector<std::thread> readers;
+    for(int t = 0; t < READERS; t++)
+      readers.emplace_back([&] {
+	  Common::ConfigWatcher::Reader reader (watcher);
+	  while(not stop) {
+	    Common::Config& pinned = reader.enter();
+
+	    // A request reads through the registry several times, it must see the configuration it entered with
+
+	    Common::Config& config = Common::Registry::getService<Common::Config>();
+	    std::string a (config.getParam("test_a"));
+	    std::this_thread::yield();
+	    std::string b (Common::Registry::getService<Common::Config>().getParam("test_b"));
+	    std::string_view expire = Common::Registry::getService<Common::Config>().getParam(Common::Keys::SESSION_EXPIRE);
+	    if(&config != &pinned or a.empty() or a != b or expire != a) {
+	      if(failures++ < 5)
+		std::fprintf(stderr, "Inconsistent configuration: test_a=%s test_b=%s session_expire=%.*s\n", a.c_str(), b.c_str(),
+			     (int) expire.size(), expire.data());
+	    }
+	    reader.leave();
+	    requests++;
+	  }
+	});
+
+    for(int generation = 1; generation <= RELOADS; generation++) {
+      writeConfig(path, generation, generation % 2);
+      usleep(2000);
+    }
+    usleep(200000); // Time for the watcher to catch up with the last rewrite
+
+    stop = true;
+    for(std::thread& t : readers)
+      t.join();
+    last = std::atoi(std::string(watcher.get().getParam("test_a")).c_str());
+  }
+  catch(Common::Exception& e) {
+    std::fprintf(stderr, "%s\n", e.getCMessage());
+    failures++;
+  }
+
+  unlink(path.c_str());
+  unlink((path + ".snapshot").c_str());
+  std::printf("%ld requests, %ld failures, last generation %d of %d\n", requests.load(), failures.load(), last, RELOADS);
+  return failures or last != RELOADS;
+}
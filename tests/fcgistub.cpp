@@ -0,0 +1,96 @@
+#include <atomic>
+#include <cstring>
+#include "fcgistub.hpp"
+#include <fcgiapp.h>
+#include <fcgi_stdio.h> // Last, it redefines the stdio functions
+
+/*! \file fcgistub.cpp
+  \brief In-memory stand-in for libfcgi, see fcgistub.hpp
+*/
+
+namespace FcgiStub {
+
+  static char** environment = NULL; // Environment of the queued requests
+  static std::atomic<size_t> pending {0}; // Requests left to accept
+  static const char* input = NULL; // Request body
+  static size_t inputLength = 0, inputPosition = 0;
+  static std::atomic<size_t> output {0}; // Bytes written
+  static FCGX_Stream in, out, err;
+
+  void serve(char** envp, size_t count) {
+    environment = envp;
+    pending = count;
+  }
+
+  void setInput(const char* data, size_t length) {
+    input = data;
+    inputLength = length;
+    inputPosition = 0;
+  }
+
+  size_t written() {
+    return output;
+  }
+
+  // Copies at most length bytes of the body to destination
+
+  static size_t take(void* destination, size_t length) {
+    if(length > inputLength - inputPosition)
+      length = inputLength - inputPosition;
+    std::memcpy(destination, input + inputPosition, length);
+    inputPosition += length;
+    return length;
+  }
+}
+
+extern "C" {
+  FCGI_FILE _fcgi_sF[3];
+
+  int FCGX_Init(void) {
+    return 0;
+  }
+
+  int FCGX_InitRequest(FCGX_Request* request, int, int) {
+    request->in = &FcgiStub::in;
+    request->out = &FcgiStub::out;
+    request->err = &FcgiStub::err;
+    request->envp = NULL;
+    return 0;
+  }
+
+  int FCGX_Accept_r(FCGX_Request* request) {
+    size_t left = FcgiStub::pending.load();
+    do {
+      if(not left)
+	return -1;
+    } while(not FcgiStub::pending.compare_exchange_weak(left, left - 1));
+    request->envp = FcgiStub::environment;
+    return 0;
+  }
+
+  void FCGX_Finish_r(FCGX_Request*) {}
+
+  void FCGX_Free(FCGX_Request*, int) {}
+
+  int FCGX_GetStr(char* str, int n, FCGX_Stream*) {
+    return FcgiStub::take(str, n);
+  }
+
+  int FCGX_PutStr(const char*, int n, FCGX_Stream*) {
+    FcgiStub::output.fetch_add(n, std::memory_order_relaxed);
+    return n;
+  }
+
+  int FCGX_PutS(const char* str, FCGX_Stream* stream) {
+    return FCGX_PutStr(str, std::strlen(str), stream);
+  }
+
+  size_t FCGI_fread(void* ptr, size_t size, size_t nmemb, FCGI_FILE*) {
+    return size ? FcgiStub::take(ptr, size * nmemb) / size : 0;
+  }
+
+  int FCGI_getchar(void) {
+    unsigned char c;
+    return FcgiStub::take(&c, 1) ? c : EOF;
+  }
+}
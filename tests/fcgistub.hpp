@@ -0,0 +1,35 @@
+#ifndef TESTS_FCGISTUB_HPP
+#define TESTS_FCGISTUB_HPP
+
+#include <cstddef>
+
+/*! \file fcgistub.hpp
+  \brief In-memory stand-in for libfcgi, for the benchmarks
+
+  tests/fcgistub.cpp defines the FCGX_* and FCGI_* functions the library uses, so that benchmarks link it instead of
+  -lfcgi: the headers of libfcgi are still needed to build. FCGX_Accept_r hands out canned requests, request bodies are
+  read from memory and output is counted and dropped. It stands in for the web server, no socket is involved, hence
+  the numbers are those of the library itself.
+*/
+
+namespace FcgiStub {
+
+  /*! \brief Queues requests for FCGX_Accept_r
+    \param[in] envp Environment of every request, it must outlive them
+    \param[in] count Number of requests, FCGX_Accept_r fails once they have all been accepted
+  */
+
+  void serve(char** envp, size_t count);
+
+  /*! \brief Sets the request body read by FCGX_GetStr and by the stdio shim (fread, getchar), from its start
+    \param[in] data Body, it must outlive its use
+    \param[in] length Length of data
+  */
+
+  void setInput(const char* data, size_t length);
+
+  //! \return Bytes written to the output streams so far
+  size_t written();
+}
+
+#endif
@@ -0,0 +1,85 @@
+#include <cgi/cgi.hpp>
+#include <clocale>
+#include <cstdio>
+#include <ctime>
+#include <map>
+#include <string>
+#include "bench.hpp"
+
+/*! \file headerbench.cpp
+  \brief Benchmark of serializing the response headers
+
+  Builds the complete body of a response with 5 headers, 10 cookies and a one byte body, and reports how many
+  responses per second are serialized. For comparison, the same headers and cookies are serialized the way
+  Response::setupHeaders did before: operator+ temporaries and, for every cookie, setlocale and strftime.
+
+  Build, from the top directory, with the sources of cgi/ but server.cpp and those of common/:\n
+  g++ -O2 -std=c++17 -I. -DPUGIXML_NO_STL tests/headerbench.cpp tests/fcgistub.cpp $(ls cgi/[a-z]*.cpp | grep -v server)
+  common/[a-z]*.cpp contrib/pugixml/pugixml.cpp -lz -lcrypto -lpthread
+*/
+
+static const int REPEATS = 200000; //!< Responses per case
+
+/*! \brief Serializes headers and cookies as Response::setupHeaders did before
+  \param[in] headers Headers
+  \param[in] cookies Cookies
+  \return Header block
+*/
+
+static std::string oldHeaders(const std::map<std::string, std::string>& headers, const CGI::Cookie::cookie_dict_t& cookies) {
+  std::string headerString;
+  for(auto d = headers.begin(); d != headers.end(); d++)
+    headerString += d->first + ": " + d->second + "\r\n";
+  for(auto c = cookies.begin(); c != cookies.end(); c++) {
+    const CGI::cookie_t& cookie = c->second;
+    char expire[29];
+    std::setlocale(LC_TIME, "en_US");
+    std::strftime(expire, 29, "%a, %d-%m-%Y %H:%M:%S GMT", std::gmtime(&cookie.expire));
+    headerString += "Set-Cookie: " + c->first + "=" + cookie.value + "; Expires=" + expire + "; ";
+    headerString += "Domain=" + cookie.domain + "; Path=" + cookie.path + "; \r\n";
+  }
+  headerString += "\r\n\r\n";
+  return headerString;
+}
+
+int main() {
+  std::unique_ptr<Common::Config> config = Bench::config("<session><expire>3600</expire></session><sess><cookiename>sid</cookiename></sess>");
+
+  char* envp[] = {(char*) "REQUEST_METHOD=GET", (char*) "HTTP_HOST=example.com", (char*) "HTTPS=on", NULL};
+  CGI::Request request (envp);
+  CGI::Response response;
+  response.setRequest(request);
+
+  std::map<std::string, std::string> headers;
+  for(const char* name : {"Content-Type", "Cache-Control", "X-Frame-Options", "Content-Language", "X-Powered-By"}) {
+    std::string value = std::string("value of ") + name;
+    response.setParam(name, value, CGI::Response::HEADER);
+    headers[name] = value;
+  }
+  time_t expire = std::time(NULL) + 3600;
+  for(int i = 0; i < 10; i++) {
+    CGI::cookie_t cookie;
+    cookie.value = "cookie value " + std::to_string(i);
+    cookie.expire = expire;
+    cookie.domain = ".example.com";
+    cookie.path = "/";
+    response.setCookie("cookie" + std::to_string(i), cookie);
+  }
+  response.appendBody("x");
+
+  size_t length = 0;
+  Bench::time_point_t start = Bench::now();
+  for(int i = 0; i < REPEATS; i++)
+    length += response.getCompleteBody().size();
+  double current = Bench::since(start);
+
+  start = Bench::now();
+  for(int i = 0; i < REPEATS; i++)
+    length += oldHeaders(headers, response.getCookies()).size();
+  double old = Bench::since(start);
+  Bench::keep(length);
+
+  std::printf("setupHeaders         %9.0f responses/s  %6.0f ns per response\n", REPEATS / current, current / REPEATS * 1e9);
+  std::printf("strftime, operator+  %9.0f responses/s  %6.0f ns per response\n", REPEATS / old, old / REPEATS * 1e9);
+  return 0;
+}
@@ -0,0 +1,78 @@
+#include <cgi/cgi.hpp>
+#include <cstdio>
+#include <string>
+#include "bench.hpp"
+
+/*! \file lookupbench.cpp
+  \brief Benchmark of the request path without a session cookie and of looking up absent parameters
+
+  Runs a cookie-less GET the way a worker of CGI::Server does (Request::reset, Response::reset, appendBody, commit,
+  flush to a StringSink) and reports the time per request. Then looks up a query parameter which is absent, with the
+  throwing Request::getParam (the exception is caught, as callers had to) and with Request::tryGetParam.
+
+  Build, from the top directory, with the sources of cgi/ but server.cpp and those of common/:\n
+  g++ -O2 -std=c++17 -I. -DPUGIXML_NO_STL tests/lookupbench.cpp tests/fcgistub.cpp $(ls cgi/[a-z]*.cpp | grep -v server)
+  common/[a-z]*.cpp contrib/pugixml/pugixml.cpp -lz -lcrypto -lpthread
+*/
+
+static const int REPEATS = 300000; //!< Iterations per case
+
+/*! \brief Runs a case and prints the time per iteration
+  \param[in] name Name of the case
+  \param[in] body One iteration
+*/
+
+template<typename body_t>
+static void run(const char* name, body_t body) {
+  Bench::time_point_t start = Bench::now();
+  for(int i = 0; i < REPEATS; i++)
+    body();
+  double spent = Bench::since(start);
+  std::printf("%-36s %7.0f ns\n", name, spent / REPEATS * 1e9);
+}
+
+int main() {
+  std::unique_ptr<Common::Config> config = Bench::config("<response><compression_level>0</compression_level></response>"
+							 "<session><expire>3600</expire></session><sess><cookiename>sid</cookiename></sess>");
+
+  char* envp[] = {(char*) "REQUEST_METHOD=GET", (char*) "QUERY_STRING=page=1", (char*) "HTTP_HOST=example.com",
+		  (char*) "SERVER_NAME=example.com", NULL};
+  CGI::Request request (envp);
+  CGI::Response response;
+  response.setRequest(request);
+  std::string out;
+  CGI::StringSink sink (out);
+
+  run("cookie-less GET, per request", [&] {
+      request.reset(envp);
+      response.reset();
+      response.appendBody("hello");
+      response.commit();
+      out.clear();
+      response.flush(sink);
+      Bench::keep(out);
+    });
+
+  struct {
+    const char* getParam;
+    const char* tryGetParam;
+    unsigned int option;
+  } lookups[] = {{"absent key, GET, getParam and catch", "absent key, GET, tryGetParam", CGI::Request::GET},
+		 {"absent key, all, getParam and catch", "absent key, all, tryGetParam",
+		  CGI::Request::GET | CGI::Request::POST | CGI::Request::SESSION | CGI::Request::ENV}};
+
+  for(auto& lookup : lookups) {
+    run(lookup.getParam, [&] {
+	try {
+	  Bench::keep(request.getParam("missing", lookup.option));
+	}
+	catch(Common::Exception& e) {
+	  Bench::keep(e);
+	}
+      });
+    run(lookup.tryGetParam, [&] {
+	Bench::keep(request.tryGetParam("missing", lookup.option));
+      });
+  }
+  return 0;
+}
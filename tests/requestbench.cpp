@@ -0,0 +1,89 @@
+#include <cgi/cgi.hpp>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <new>
+#include <string>
+#include <vector>
+#include "bench.hpp"
+
+/*! \file requestbench.cpp
+  \brief Benchmark of building a CGI::Request
+
+  Builds a Request from a synthetic environment of 60 variables, as a FastCGI request carries, and reports the heap
+  allocations and the time per request. Requests are built anew, as a plain CGI process does, and reset, as the
+  workers of CGI::Server do. For comparison, the environment alone is also copied into a std::map<std::string,
+  std::string>, the way Request held it before it kept views into envp.
+
+  Build, from the top directory, with the sources of cgi/ but server.cpp and those of common/:\n
+  g++ -O2 -std=c++17 -I. -DPUGIXML_NO_STL tests/requestbench.cpp tests/fcgistub.cpp $(ls cgi/[a-z]*.cpp | grep -v server)
+  common/[a-z]*.cpp contrib/pugixml/pugixml.cpp -lz -lcrypto -lpthread
+*/
+
+static size_t allocations = 0; //!< Calls of operator new so far
+
+void* operator new(size_t size) {
+  allocations++;
+  if(void* p = std::malloc(size ? size : 1))
+    return p;
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+  std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+  std::free(p);
+}
+
+static const int REPEATS = 100000; //!< Requests per case
+
+/*! \brief Runs a case and prints the allocations and the time per request
+  \param[in] name Name of the case
+  \param[in] body Builds one request
+*/
+
+template<typename body_t>
+static void run(const char* name, body_t body) {
+  size_t first = allocations;
+  Bench::time_point_t start = Bench::now();
+  for(int i = 0; i < REPEATS; i++)
+    body();
+  double spent = Bench::since(start);
+  std::printf("%-28s %6.1f allocations  %6.0f ns per request\n", name, (double) (allocations - first) / REPEATS, spent / REPEATS * 1e9);
+}
+
+int main() {
+  std::unique_ptr<Common::Config> config = Bench::config("<session><expire>3600</expire></session><sess><cookiename>sid</cookiename></sess>");
+
+  std::vector<std::string> variables = {"QUERY_STRING=page=2&sort=date&q=hello+world", "REQUEST_METHOD=GET", "HTTP_HOST=example.com"};
+  for(int i = 0; variables.size() < 60; i++)
+    variables.push_back("HTTP_X_SYNTHETIC_HEADER_" + std::to_string(i) + "=some header value number " + std::to_string(i * 31));
+  std::vector<char*> envp;
+  for(std::string& v : variables)
+    envp.push_back(&v[0]);
+  envp.push_back(NULL);
+
+  run("Request built anew", [&] {
+      CGI::Request request (envp.data());
+      Bench::keep(request);
+    });
+
+  CGI::Request reused (envp.data());
+  run("Request reset", [&] {
+      reused.reset(envp.data());
+      Bench::keep(reused);
+    });
+
+  run("std::map of the environment", [&] {
+      std::map<std::string, std::string> env;
+      for(char** e = envp.data(); *e; e++) {
+	std::string variable (*e);
+	size_t equals = variable.find('=');
+	env[variable.substr(0, equals)] = variable.substr(equals + 1);
+      }
+      Bench::keep(env);
+    });
+  return 0;
+}
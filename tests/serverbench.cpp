@@ -0,0 +1,91 @@
+#include <cgi/cgi.hpp>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+#include "bench.hpp"
+#include "fcgistub.hpp"
+
+/*! \file serverbench.cpp
+  \brief Requests per second of CGI::Server
+
+  Runs the accept loop of CGI::Server against tests/fcgistub.cpp, which stands in for the web server: FCGX_Accept_r
+  hands out a GET request with a realistic environment and the output is counted and dropped. The handler reads a
+  query parameter and renders an empty page, then a page of about 4 KB, compression is off so that zlib does not
+  dominate. The figures are the cost of the server, the library and the handler per request, without any socket.
+  A last case renders the 4 KB page after sleeping 100 us, as a handler waiting for a database does, with a tenth of
+  the requests.
+
+  Every case runs with 1, 2, 4 and 8 worker threads (or those given), the workers sharing the listening socket as
+  Server::run sets them up. Threads beyond the number of cores only help handlers which wait.
+
+  Build, from the top directory, with the sources of cgi/ and common/ (the libfcgi headers are needed, not the library):\n
+  g++ -O2 -std=c++17 -I. -DPUGIXML_NO_STL tests/serverbench.cpp tests/fcgistub.cpp cgi/[a-z]*.cpp common/[a-z]*.cpp
+  contrib/pugixml/pugixml.cpp -lz -lcrypto -lpthread
+
+  Usage: a.out [number of requests, 200000 by default] [numbers of threads, 1 2 4 8 by default]
+*/
+
+static int items = 0; //!< List items rendered by #handle
+static useconds_t delay = 0; //!< Microseconds #handle sleeps for
+
+//! Renders a page holding #items list items, about 4 KB for 80
+static void handle(CGI::Request& request, CGI::Response& response) {
+  if(delay)
+    usleep(delay);
+  std::optional<std::string_view> page = request.tryGetParam("page", CGI::Request::GET);
+  response.setParam("Content-Type", "text/html; charset=utf-8", CGI::Response::HEADER);
+  response.appendBody("<html><head><title>Page ");
+  response.appendBody(page ? *page : "1");
+  response.appendBody("</title></head><body><ul>");
+  for(int i = 0; i < items; i++)
+    response.appendBody("<li><a href=\"/item/" + std::to_string(i) + "\">Item number " + std::to_string(i) + "</a></li>");
+  response.appendBody("</ul></body></html>");
+}
+
+int main(int argc, char** argv) {
+  size_t requests = argc > 1 ? std::strtoul(argv[1], NULL, 10) : 200000;
+  std::string path = "/tmp/cxxcms-serverbench-" + std::to_string(getpid()) + ".xml";
+  {
+    std::ofstream out (path);
+    out << "<config><response><compression_level>0</compression_level></response>"
+      "<session><expire>3600</expire></session><sess><cookiename>sid</cookiename></sess></config>\n";
+  }
+
+  char* envp[] = {(char*) "REQUEST_METHOD=GET", (char*) "QUERY_STRING=page=2&sort=date", (char*) "REQUEST_URI=/list?page=2&sort=date",
+		  (char*) "HTTP_HOST=example.com", (char*) "SERVER_NAME=example.com", (char*) "HTTP_ACCEPT_ENCODING=gzip, deflate",
+		  (char*) "HTTP_USER_AGENT=Mozilla/5.0 (X11; Linux x86_64)", (char*) "HTTP_ACCEPT=text/html,application/xhtml+xml",
+		  (char*) "REMOTE_ADDR=192.0.2.10", (char*) "SERVER_PROTOCOL=HTTP/1.1", NULL};
+
+  std::vector<unsigned int> threads;
+  for(int i = 2; i < argc; i++)
+    threads.push_back(std::strtoul(argv[i], NULL, 10));
+  if(threads.empty())
+    threads = {1, 2, 4, 8};
+
+  struct {
+    int items;
+    useconds_t delay;
+    size_t requests;
+  } cases[] = {{0, 0, requests}, {80, 0, requests}, {80, 100, requests / 10}};
+
+  int status = 0;
+  for(auto& c : cases)
+    for(unsigned int n : threads) {
+      items = c.items;
+      delay = c.delay;
+      CGI::Server server (path, handle);
+      FcgiStub::serve(envp, c.requests);
+      size_t written = FcgiStub::written();
+      Bench::time_point_t start = Bench::now();
+      status |= server.run(n);
+      double spent = Bench::since(start);
+      std::printf("%4zu byte responses, %3u us wait, %u worker%s: %8.0f requests/s\n", (FcgiStub::written() - written) / c.requests,
+		  (unsigned int) c.delay, n, n > 1 ? "s" : " ", c.requests / spent);
+    }
+  unlink(path.c_str());
+  unlink((path + ".snapshot").c_str());
+  return status;
+}
@@ -0,0 +1,65 @@
+#include <cgi/cgi.hpp>
+#include <cstdio>
+#include <string>
+#include <uuid/uuid.h>
+#include "bench.hpp"
+
+/*! \file sessionidbench.cpp
+  \brief Benchmark of generating session ids
+
+  Reports how many ids per second are generated: the 16 random bytes of an id drawn from Common::randomBytes, a new
+  CGI::Session (whose id is drawn and written in hex, plus the state of the session), and, for comparison, libuuid as
+  Session used it before, uuid_generate then uuid_unparse, and uuid_generate_random then uuid_unparse.
+
+  Build, from the top directory, with the sources of cgi/ but server.cpp and those of common/:\n
+  g++ -O2 -std=c++17 -I. -DPUGIXML_NO_STL tests/sessionidbench.cpp tests/fcgistub.cpp $(ls cgi/[a-z]*.cpp | grep -v server)
+  common/[a-z]*.cpp contrib/pugixml/pugixml.cpp -lz -lcrypto -lpthread -luuid
+*/
+
+static const int REPEATS = 1000000; //!< Ids per case
+
+/*! \brief Runs a case and prints the ids per second
+  \param[in] name Name of the case
+  \param[in] body Generates one id
+*/
+
+template<typename body_t>
+static void run(const char* name, body_t body) {
+  Bench::time_point_t start = Bench::now();
+  for(int i = 0; i < REPEATS; i++)
+    body();
+  double spent = Bench::since(start);
+  std::printf("%-34s %6.2f M ids/s  %6.0f ns per id\n", name, REPEATS / spent / 1e6, spent / REPEATS * 1e9);
+}
+
+int main() {
+  std::unique_ptr<Common::Config> config = Bench::config("<session><expire>3600</expire></session><sess><cookiename>sid</cookiename></sess>");
+
+  run("Common::randomBytes, 16 bytes", [] {
+      unsigned char bytes[16];
+      Common::randomBytes(bytes, sizeof bytes);
+      Bench::keep(bytes);
+    });
+
+  run("new CGI::Session", [] {
+      CGI::Session session;
+      Bench::keep(session);
+    });
+
+  run("uuid_generate, uuid_unparse", [] {
+      uuid_t uuid;
+      char id[37];
+      uuid_generate(uuid);
+      uuid_unparse(uuid, id);
+      Bench::keep(id);
+    });
+
+  run("uuid_generate_random, uuid_unparse", [] {
+      uuid_t uuid;
+      char id[37];
+      uuid_generate_random(uuid);
+      uuid_unparse(uuid, id);
+      Bench::keep(id);
+    });
+  return 0;
+}
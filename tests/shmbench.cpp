@@ -0,0 +1,90 @@
+#include <cgi/cgi.hpp>
+#include <atomic>
+#include <cstdio>
+#include <ctime>
+#include <string>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "bench.hpp"
+
+/*! \file shmbench.cpp
+  \brief Benchmark of CGI::ShmSessionStore
+
+  Fills a store in /dev/shm with 10000 sessions of three values, then has 1 and 8 forked processes look up random
+  sessions for two seconds each, as the FastCGI processes of a site share the store, and reports the lookups per
+  second of all of them together. A last case has 5% of the operations save a session. Every lookup checks the value it
+  got back, a mismatch is reported on stderr.
+
+  Build, from the top directory, with the sources of cgi/ but server.cpp and those of common/:\n
+  g++ -O2 -std=c++17 -I. -DPUGIXML_NO_STL tests/shmbench.cpp tests/fcgistub.cpp $(ls cgi/[a-z]*.cpp | grep -v server)
+  common/[a-z]*.cpp contrib/pugixml/pugixml.cpp -lz -lcrypto -lpthread
+*/
+
+static const int SESSIONS = 10000; //!< Sessions in the store
+static const double SECONDS = 2; //!< Duration of a case
+
+//! \return Id of session i, as long as a real one
+static std::string idOf(int i) {
+  return "0a833832-58ee-4b1c-ad70-" + std::to_string(100000000000LL + i);
+}
+
+/*! \brief Runs a case
+  \param[in] path Path of the store
+  \param[in] processes Number of processes
+  \param[in] writes Percentage of saves among the operations
+  \return Operations per second of all processes together
+*/
+
+static double run(const std::string& path, int processes, unsigned int writes) {
+  std::atomic<long>* total = (std::atomic<long>*) mmap(NULL, sizeof(std::atomic<long>), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if(total == MAP_FAILED)
+    return 0;
+  new (total) std::atomic<long> (0);
+  for(int p = 0; p < processes; p++)
+    if(not fork()) {
+      CGI::ShmSessionStore store (path, 32768, 1024);
+      long operations = 0, mismatches = 0;
+      unsigned int x = p * 7919 + 1;
+      Common::PersistentDict data;
+      time_t expire;
+      Bench::time_point_t start = Bench::now();
+      while(Bench::since(start) < SECONDS)
+	for(int k = 0; k < 256; k++, operations++) {
+	  x = x * 1103515245 + 12345;
+	  int i = (x >> 8) % SESSIONS;
+	  std::string user = "user" + std::to_string(i);
+	  if(x % 100 < writes)
+	    store.save(idOf(i), Common::PersistentDict().set("user", user).set("n", std::to_string(x)), std::time(NULL) + 3600);
+	  else if(not store.load(idOf(i), data, expire) or not data.find("user") or data.find("user")->second != user)
+	    mismatches++;
+	}
+      total->fetch_add(operations);
+      if(mismatches)
+	std::fprintf(stderr, "process %d: %ld lookups returned the wrong session\n", p, mismatches);
+      _exit(0);
+    }
+  while(wait(NULL) > 0);
+  double rate = total->load() / SECONDS;
+  munmap(total, sizeof(std::atomic<long>));
+  return rate;
+}
+
+int main() {
+  std::string path = "/dev/shm/cxxcms-shmbench-" + std::to_string(getpid());
+  {
+    CGI::ShmSessionStore store (path, 32768, 1024);
+    for(int i = 0; i < SESSIONS; i++) {
+      Common::PersistentDict data;
+      data = data.set("user", "user" + std::to_string(i));
+      data = data.set("cart", "1,2,3");
+      data = data.set("csrf", "abcdef0123456789");
+      store.save(idOf(i), data, std::time(NULL) + 3600);
+    }
+  }
+  for(int processes : {1, 8})
+    std::printf("%d %-9s lookups only: %5.2f M lookups/s\n", processes, processes > 1 ? "processes," : "process,", run(path, processes, 0) / 1e6);
+  std::printf("8 processes, 5%% saves:    %5.2f M operations/s\n", run(path, 8, 5) / 1e6);
+  unlink(path.c_str());
+  return 0;
+}
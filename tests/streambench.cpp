@@ -0,0 +1,129 @@
+#include <cgi/cgi.hpp>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "bench.hpp"
+
+/*! \file streambench.cpp
+  \brief Benchmark of streaming a large response
+
+  Generates a page of 5 MB in fragments of 200 bytes and writes it to /dev/null through an FdSink, once buffered (the
+  page is held and flushed at the end) and once in streaming mode (see Response::setStreaming). Reports the time to
+  the first byte handed to the sink, the total time and how much the peak resident set grew while the page was
+  generated. Each mode runs in a child process of its own, so that the peaks do not mix.
+
+  Build, from the top directory, with the sources of cgi/ but server.cpp and those of common/:\n
+  g++ -O2 -std=c++17 -I. -DPUGIXML_NO_STL tests/streambench.cpp tests/fcgistub.cpp $(ls cgi/[a-z]*.cpp | grep -v server)
+  common/[a-z]*.cpp contrib/pugixml/pugixml.cpp -lz -lcrypto -lpthread
+*/
+
+static const size_t PAGE = 5 << 20; //!< Size of the page
+static const size_t FRAGMENT = 200; //!< Size of the pieces the page is generated in
+
+//! Sink passing the data on to another one and noting when it first got some
+
+class TimingSink : public CGI::Sink {
+private:
+  CGI::Sink& next; //!< Destination
+  Bench::time_point_t start; //!< Start of the response
+
+public:
+  double first; //!< Seconds from the start to the first write, negative until then
+
+  /*! \param[in] _next Destination
+    \param[in] _start Start of the response
+  */
+
+  TimingSink(CGI::Sink& _next, Bench::time_point_t _start) : next(_next), start(_start), first(-1) {}
+
+  void write(const struct iovec* iov, int count) {
+    if(first < 0)
+      first = Bench::since(start);
+    next.write(iov, count);
+  }
+};
+
+//! Figures a child sends back
+struct result_t {
+  double firstByte; //!< Seconds to the first byte
+  double total; //!< Seconds to the end of the response
+  long growth; //!< Growth of the peak resident set, in KB
+};
+
+//! \return Peak resident set of the process so far, in KB
+static long peak() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+/*! \brief Generates the page in a child process
+  \param[in] high High watermark, 0 to buffer the page
+  \param[in] low Low watermark
+  \param[out] result Figures of the child
+  \return true on success
+*/
+
+static bool run(size_t high, size_t low, result_t& result) {
+  int channel[2];
+  if(pipe(channel))
+    return false;
+  pid_t child = fork();
+  if(child < 0)
+    return false;
+  if(not child) {
+    close(channel[0]);
+    std::unique_ptr<Common::Config> config = Bench::config("<response><compression_level>0</compression_level></response>"
+							   "<session><expire>3600</expire></session><sess><cookiename>sid</cookiename></sess>");
+    char* envp[] = {(char*) "REQUEST_METHOD=GET", (char*) "HTTP_HOST=example.com", NULL};
+    CGI::Request request (envp);
+    CGI::Response response;
+    response.setRequest(request);
+    int fd = open("/dev/null", O_WRONLY);
+    CGI::FdSink null (fd);
+    std::string fragment (FRAGMENT - 1, 'x');
+    fragment += '\n';
+
+    long before = peak();
+    Bench::time_point_t start = Bench::now();
+    TimingSink sink (null, start);
+    response.setSink(&sink).setStreaming(high, low);
+    response.setParam("Content-Type", "text/plain", CGI::Response::HEADER);
+    for(size_t written = 0; written < PAGE; written += FRAGMENT)
+      response.appendBody(fragment);
+    response.flush();
+    result.total = Bench::since(start);
+    result.firstByte = sink.first;
+    result.growth = peak() - before;
+    close(fd);
+    _exit(write(channel[1], &result, sizeof(result)) == sizeof(result) ? 0 : 1);
+  }
+  close(channel[1]);
+  bool done = read(channel[0], &result, sizeof(result)) == sizeof(result);
+  close(channel[0]);
+  int status;
+  waitpid(child, &status, 0);
+  return done and WIFEXITED(status) and not WEXITSTATUS(status);
+}
+
+int main() {
+  struct {
+    const char* name;
+    size_t high, low;
+  } modes[] = {{"buffered", 0, 0}, {"streaming 64 KB / 16 KB", 64 << 10, 16 << 10}};
+
+  for(auto& mode : modes) {
+    result_t result;
+    if(not run(mode.high, mode.low, result)) {
+      std::fprintf(stderr, "%s: the child failed\n", mode.name);
+      return 1;
+    }
+    std::printf("%-24s first byte %9.1f us  total %7.2f ms  peak RSS +%6ld KB\n", mode.name, result.firstByte * 1e6,
+		result.total * 1e3, result.growth);
+  }
+  return 0;
+}